@@ -30,5 +30,20 @@ int main() {
          << " " << v.data[1] << " " << v.data[2] << endl;
   }
 
+  // Continuous acquisition with a slow consumer: with a queue of 2 batches
+  // and the drop_oldest policy, only the latest batches are kept
+  Acquisitor<>::queue q(2, overflow_policy::drop_oldest);
+  acq.start(q);
+  this_thread::sleep_for(milliseconds(1000));
+  Acquisitor<>::batch b;
+  for (int i = 0; i < 2; i++) {
+    q.pop(b);
+    cout << "batch " << i << ": " << b.size() << " samples from "
+         << b.front().time_since(today) << endl;
+  }
+  acq.stop();
+  cout << "queue high water: " << q.high_water() << ", dropped: "
+       << q.dropped() << endl;
+
   return 0;
 }
\ No newline at end of file
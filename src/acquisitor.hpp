@@ -13,6 +13,7 @@ Date: 2025-10-07
 */
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <array>
 #include <map>
@@ -23,6 +24,12 @@ Date: 2025-10-07
 #include <tuple>
 #include <thread>
 #include <future>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include "batch_queue.hpp"
+#include "timing.hpp"
 
 #define DEFAULT_SIZE 100
 
@@ -53,6 +60,13 @@ private:
 };
 
 
+// std::array of floating point or integer values
+template <typename T>
+struct is_numeric_array : false_type {};
+template <typename V, size_t N>
+struct is_numeric_array<array<V, N>> : bool_constant<is_arithmetic_v<V>> {};
+
+
 template <typename T = array<double, 3>>
 class Acquisitor {
 public:
@@ -65,11 +79,20 @@ public:
     }
   };
 
+  using batch = vector<sample>;
+  using queue = BatchQueue<batch>;
+
   Acquisitor(json settings, size_t capa = 0) : _settings(settings) {
     if (capa == 0) capa = _settings.value("capacity", DEFAULT_SIZE);
     _capa = capa;
-    _data.reserve(_capa);
+    // buffers are preallocated for the largest capacity (see set_capa())
+    _max_capa = max(capa, _settings.value("max_capacity", (size_t)0));
+    _data.reserve(_max_capa);
+    // 0: batches are complete only when full
+    _max_latency = duration<double, milli>(_settings.value("max_batch_latency_ms", 0.0));
   }
+
+  virtual ~Acquisitor() { stop(); }
   
   // Initialize connections
   virtual void setup() {
@@ -78,31 +101,38 @@ public:
     _rnd.set(m, sd);
   }
 
-  // Single acquisition
+  // Single acquisition: random values in each element of T (an array of
+  // floating point or integer values, e.g. raw ADC counts)
   virtual void acquire() {
-    if (!is_same<array<double, 3>, T>::value) {
-      throw runtime_error("Base class only supports data of type std::array<double, 3>; implement child class for different types");
+    if constexpr (!is_numeric_array<T>::value) {
+      throw runtime_error("Base class only supports data of type std::array of numbers; implement child class for different types");
+    } else {
+      if (is_full()) throw AcquisitorException();
+
+      sample s{system_clock::now(), {}};
+      for (auto &v : s.data) v = random_value<typename T::value_type>();
+      _data.push_back(s);
+      this_thread::sleep_for(milliseconds(20));
     }
-    if (is_full()) throw AcquisitorException();
-
-    sample s{
-      system_clock::now(),
-      {_rnd.get(), _rnd.get(), _rnd.get()}
-    };
-    _data.push_back(s);
-    this_thread::sleep_for(milliseconds(20));
   }
 
-  // Fill the buffer by calling acquire() until the buffer is full
+  // Fill the buffer by calling acquire() until the buffer is full, or until
+  // its oldest sample is older than max_batch_latency_ms (checked after each
+  // acquire(), which therefore should not block for too long), or stop()
   void fill_buffer(bool reset = true) {
     if (reset) _data.clear();
     _loading = true;
-    while (true) {
+    while (!_stop_requested) {
       try {
         acquire();
       } catch(AcquisitorException &e) {
         break;
       }
+      if (_max_latency.count() > 0 && !_data.empty() &&
+          system_clock::now() - _data.front().time >= _max_latency) {
+        _flushed++;
+        break;
+      }
     }
     _loading = false;
   }
@@ -117,25 +147,113 @@ public:
 
   inline void wait() { _future_data.wait(); }
 
+  // Continuous acquisition: fill batches in a background thread and push
+  // them into q, until stop() is called. Derived classes must call stop()
+  // in their destructor (or the owner before destroying them), since the
+  // thread calls acquire()
+  void start(queue &q) {
+    stop();
+    _queue = &q;
+    _queue->open();
+    _streaming = true;
+    _stop_requested = false;
+    _streamer = thread([this]() {
+      while (_streaming) {
+        TIMING_START(t0);
+        fill_buffer();
+        TIMING_RECORD(_fill_time, t0);
+        if (!_streaming) break;
+        if (!_data.empty() && !_queue->push(std::move(_data))) break;
+        // finite sources: consumers get the queued batches, then pop() fails
+        if (exhausted()) {
+          _streaming = false;
+          _queue->close();
+          break;
+        }
+        _data = batch();
+        _data.reserve(_max_capa);
+      }
+    });
+  }
+
+  void stop() {
+    _streaming = false;
+    _stop_requested = true;
+    if (_queue) _queue->close();
+    if (_streamer.joinable()) _streamer.join();
+    _queue = nullptr;
+  }
+
+  bool streaming() const { return _streaming; }
+
+  // Whether the source has no more data (e.g. the end of a replayed file):
+  // acquire() should then throw AcquisitorException
+  virtual bool exhausted() const { return false; }
+
+  // Number of batches completed by max_batch_latency_ms rather than full
+  size_t flushed() const { return _flushed; }
+
+#ifdef BUFFERED_TIMING
+  // Time spent filling each batch in the acquisition thread
+  LatencyHistogram const &fill_time() const { return _fill_time; }
+#endif
+
 
   auto &data() const { return _data; }
   T operator[](size_t i) const { return _data[i]; }
   size_t size() const { return _data.size(); }
   size_t capa() const { return _capa; }
-  bool is_full() const { return _data.size() == _capa; }
+  // change the capacity (up to max_capacity); safe while streaming, it
+  // applies to the batch being filled
+  void set_capa(size_t capa) { _capa = clamp<size_t>(capa, 1, _max_capa); }
+  bool is_full() const { return _data.size() >= _capa; }
   void reset() { _data.clear(); }
   future<vector<sample>> &future_data() { return _future_data; }
   bool loading() const { return _loading; }
 
   protected:
+  // x as a sample value: rounded and clamped to the range of integer types
+  template <typename V>
+  static V to_value(double x) {
+    if constexpr (is_floating_point_v<V>) {
+      return (V)x;
+    } else {
+      return (V)clamp(round(x), (double)numeric_limits<V>::lowest(), (double)numeric_limits<V>::max());
+    }
+  }
+
+  template <typename V>
+  V random_value() { return to_value<V>(_rnd.get()); }
+
   json _settings;
-  size_t _capa;
+  atomic<size_t> _capa;
+  size_t _max_capa;
   vector<sample> _data;
   runif _rnd;
   future<vector<sample>> _future_data;
   bool _loading = true;
+  queue *_queue = nullptr;
+  thread _streamer;
+  atomic<bool> _streaming = false;
+  atomic<bool> _stop_requested = false;
+  duration<double, milli> _max_latency;
+  atomic<size_t> _flushed = 0;
+#ifdef BUFFERED_TIMING
+  LatencyHistogram _fill_time;
+#endif
 };
 
 
-
-
+// Append the samples of a batch to the JSON array rows, one [time, data...]
+// row per sample, with time in seconds since t0: the raw output format of
+// the plugins
+template <typename Sample>
+void package_raw(vector<Sample> const &batch,
+                 time_point<system_clock, nanoseconds> t0, json &rows) {
+  json e;
+  for (auto &sample : batch) {
+    e = sample.data;
+    e.insert(e.begin(), sample.time_since(t0));
+    rows.push_back(e);
+  }
+}
@@ -0,0 +1,150 @@
+/*
+   ___
+  / _ \ _   _  ___ _   _  ___
+ | | | | | | |/ _ \ | | |/ _ \
+ | |_| | |_| |  __/ |_| |  __/
+  \__\_\\__,_|\___|\__,_|\___|
+
+Bounded queue of acquired batches, between the acquisition thread (producer)
+and get_output() (consumer). When the consumer falls behind and the queue is
+full, the overflow policy decides what happens:
+  block       : the producer waits (acquisition stalls, nothing is lost)
+  drop_oldest : the oldest queued batch is discarded
+  drop_newest : the incoming batch is discarded
+  decimate    : the two oldest batches are merged into one, keeping every
+                other sample (time coverage is kept, resolution is halved)
+All losses are counted, so that they can be reported downstream.
+*/
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+enum class overflow_policy { block, drop_oldest, drop_newest, decimate };
+
+inline overflow_policy overflow_policy_from_string(std::string const &s) {
+  if (s == "block") return overflow_policy::block;
+  if (s == "drop_oldest") return overflow_policy::drop_oldest;
+  if (s == "drop_newest") return overflow_policy::drop_newest;
+  if (s == "decimate") return overflow_policy::decimate;
+  throw std::invalid_argument("Unknown overflow policy: " + s);
+}
+
+// Batch is a vector-like container of samples
+template <typename Batch>
+class BatchQueue {
+public:
+  BatchQueue(size_t depth = 2, overflow_policy policy = overflow_policy::block)
+      : _depth(depth > 0 ? depth : 1), _policy(policy) {}
+
+  // Enqueue a batch, applying the overflow policy; returns false if the
+  // queue has been closed
+  bool push(Batch &&b) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    if (_closed) return false;
+    if (_q.size() >= _depth) {
+      switch (_policy) {
+      case overflow_policy::block:
+        _stalls++;
+        _not_full.wait(lock, [this] { return _q.size() < _depth || _closed; });
+        if (_closed) return false;
+        break;
+      case overflow_policy::drop_oldest:
+        _dropped++;
+        _q.pop_front();
+        break;
+      case overflow_policy::drop_newest:
+        _dropped++;
+        return true;
+      case overflow_policy::decimate:
+        _decimated++;
+        if (_q.size() >= 2) {
+          Batch merged = halve(_q[0], _q[1]);
+          _q.pop_front();
+          _q.front() = std::move(merged);
+        } else {
+          b = halve(_q.front(), b);
+          _q.pop_front();
+        }
+        break;
+      }
+    }
+    _q.push_back(std::move(b));
+    if (_q.size() > _high_water) _high_water = _q.size();
+    _not_empty.notify_one();
+    return true;
+  }
+
+  // Dequeue the oldest batch, waiting for one if the queue is empty; returns
+  // false if the queue is closed and empty
+  bool pop(Batch &b) {
+    std::unique_lock<std::mutex> lock(_mtx);
+    _not_empty.wait(lock, [this] { return !_q.empty() || _closed; });
+    if (_q.empty()) return false;
+    b = std::move(_q.front());
+    _q.pop_front();
+    _not_full.notify_one();
+    return true;
+  }
+
+  // Dequeue the oldest batch if any, without waiting
+  bool try_pop(Batch &b) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_q.empty()) return false;
+    b = std::move(_q.front());
+    _q.pop_front();
+    _not_full.notify_one();
+    return true;
+  }
+
+  // Wake up and reject any further push/pop (queued batches can still be
+  // popped)
+  void close() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _closed = true;
+    _not_empty.notify_all();
+    _not_full.notify_all();
+  }
+
+  void open() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _closed = false;
+  }
+
+  size_t depth() const { return _depth; }
+  overflow_policy policy() const { return _policy; }
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _q.size();
+  }
+  size_t high_water() const { return locked(_high_water); }
+  size_t dropped() const { return locked(_dropped); }
+  size_t decimated() const { return locked(_decimated); }
+  size_t stalls() const { return locked(_stalls); }
+
+private:
+  size_t _depth;
+  overflow_policy _policy;
+  std::deque<Batch> _q;
+  mutable std::mutex _mtx;
+  std::condition_variable _not_empty, _not_full;
+  bool _closed = false;
+  size_t _high_water = 0, _dropped = 0, _decimated = 0, _stalls = 0;
+
+  size_t locked(size_t const &v) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return v;
+  }
+
+  // every other sample of the concatenation of a and b
+  static Batch halve(Batch const &a, Batch const &b) {
+    Batch r;
+    r.reserve((a.size() + b.size() + 1) / 2);
+    for (size_t i = 0; i < a.size() + b.size(); i += 2)
+      r.push_back(i < a.size() ? a[i] : b[i - a.size()]);
+    return r;
+  }
+};
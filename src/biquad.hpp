@@ -0,0 +1,137 @@
+/*
+  ____  _                       _
+ | __ )(_) __ _ _   _  __ _  __| |
+ |  _ \| |/ _` | | | |/ _` |/ _` |
+ | |_) | | (_| | |_| | (_| | (_| |
+ |____/|_|\__, |\__,_|\__,_|\__,_|
+             |_|
+Cascade of biquad IIR filters applied to acquisition batches, for DC removal
+and band-limiting before analysis. Sections are designed from the plugin
+settings (RBJ cookbook formulas, Butterworth Q values for higher orders) and
+run in transposed direct form II; the filter state is kept across batches.
+Configured by the plugin settings:
+  filters = [{type = "dcblock", cutoff = 0.5},
+             {type = "lowpass", cutoff = 200.0, order = 4}]
+  sample_rate = 1000.0  # Hz (default: from the timestamps of the 1st batch)
+with type one of lowpass, highpass, bandpass, dcblock; order (default: 2)
+must be even, and the cutoff below the Nyquist frequency; Q (default: 0.7071
+for lowpass and highpass, 1.0 for bandpass) applies to order 2 only.
+*/
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Sample is an Acquisitor<T>::sample, with T an array-like container of
+// scalars; the inner loop runs (and vectorizes) across channels
+template <typename Sample>
+class BiquadCascade {
+public:
+  using json = nlohmann::json;
+
+  struct Section {
+    double b0, b1, b2, a1, a2; // a0 normalized to 1
+  };
+
+  BiquadCascade(json const &settings) {
+    _sample_rate = settings.value("sample_rate", 0.0);
+    _specs = settings.value("filters", json::array());
+    for (auto const &f : _specs) {
+      std::string type = f.value("type", "");
+      if (type != "lowpass" && type != "highpass" && type != "bandpass" &&
+          type != "dcblock")
+        throw std::invalid_argument("Unknown filter type: " + type);
+      int order = f.value("order", 2);
+      if (type != "dcblock" && (order < 2 || order % 2 != 0))
+        throw std::invalid_argument("Filter order must be even: " + std::to_string(order));
+    }
+    if (_sample_rate > 0) design(_sample_rate);
+  }
+
+  std::vector<Section> const &sections() const { return _sections; }
+
+  // Filter a batch in place
+  void process(std::vector<Sample> &batch) {
+    if (batch.empty() || _specs.empty()) return;
+    if (_sections.empty()) {
+      double span = batch.back().time_since(batch.front().time);
+      design(span > 0 ? (batch.size() - 1) / span : 1.0);
+    }
+    const size_t nc = batch[0].data.size();
+    if (_z.size() != 2 * nc * _sections.size())
+      _z.assign(2 * nc * _sections.size(), 0.0);
+    for (auto &s : batch) {
+      double *z = _z.data();
+      for (auto const &q : _sections) {
+        double *z1 = z, *z2 = z + nc;
+        for (size_t c = 0; c < nc; c++) {
+          const double x = s.data[c];
+          const double y = q.b0 * x + z1[c];
+          z1[c] = q.b1 * x - q.a1 * y + z2[c];
+          z2[c] = q.b2 * x - q.a2 * y;
+          s.data[c] = y;
+        }
+        z += 2 * nc;
+      }
+    }
+  }
+
+  void reset() { _z.assign(_z.size(), 0.0); }
+
+private:
+  double _sample_rate = 0;
+  json _specs;
+  std::vector<Section> _sections;
+  std::vector<double> _z; // per section: z1[channels], z2[channels]
+
+  void design(double fs) {
+    _sections.clear();
+    for (auto const &f : _specs) {
+      std::string type = f.value("type", "");
+      double fc = f.value("cutoff", type == "dcblock" ? 0.5 : fs / 4);
+      if (fc <= 0 || fc >= fs / 2)
+        throw std::invalid_argument("Filter cutoff must be between 0 and the Nyquist frequency: " +
+                                    std::to_string(fc));
+      if (type == "dcblock") {
+        // y[n] = x[n] - x[n-1] + r y[n-1]
+        double r = std::exp(-2 * M_PI * fc / fs);
+        _sections.push_back({1.0, -1.0, 0.0, -r, 0.0});
+        continue;
+      }
+      const int n = f.value("order", 2) / 2;
+      for (int k = 0; k < n; k++) {
+        double Q;
+        if (type == "bandpass")
+          Q = f.value("Q", 1.0);
+        else if (n == 1)
+          Q = f.value("Q", M_SQRT1_2);
+        else // Butterworth pole pairs
+          Q = 1.0 / (2 * std::cos(M_PI * (2 * k + 1) / (4.0 * n)));
+        _sections.push_back(rbj(type, fc / fs, Q));
+      }
+    }
+  }
+
+  // Biquad coefficients from R. Bristow-Johnson's Audio EQ Cookbook,
+  // f normalized to the sample rate
+  static Section rbj(std::string const &type, double f, double Q) {
+    const double w = 2 * M_PI * f, cw = std::cos(w);
+    const double alpha = std::sin(w) / (2 * Q), a0 = 1 + alpha;
+    double b0, b1, b2;
+    if (type == "lowpass") {
+      b1 = (1 - cw);
+      b0 = b2 = b1 / 2;
+    } else if (type == "highpass") {
+      b1 = -(1 + cw);
+      b0 = b2 = -b1 / 2;
+    } else { // bandpass, 0 dB peak gain
+      b0 = alpha;
+      b1 = 0;
+      b2 = -alpha;
+    }
+    return {b0 / a0, b1 / a0, b2 / a0, -2 * cw / a0, (1 - alpha) / a0};
+  }
+};
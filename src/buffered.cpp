@@ -20,6 +20,14 @@
 // other includes as needed here
 #include <chrono>
 #include "acquisitor.hpp"
+#include "biquad.hpp"
+#include "capacity_controller.hpp"
+#include "decimator.hpp"
+#include "features.hpp"
+#include "recorder.hpp"
+#include "replay_acq.hpp"
+#include "scaling.hpp"
+#include "trigger.hpp"
 
 // Define the name of the plugin
 #ifndef PLUGIN_NAME
@@ -30,6 +38,15 @@
 using namespace std;
 using json = nlohmann::json;
 
+// Raw sample values, as acquired, queued and recorded: set by the
+// BUFFERED_RAW_TYPE CMake option (e.g. int16_t for ADC counts). They are
+// converted to engineering units (Acquisitor<>::sample, in double) only where
+// needed
+#ifndef BUFFERED_RAW_TYPE
+#define BUFFERED_RAW_TYPE double
+#endif
+using RawAcquisitor = Acquisitor<array<BUFFERED_RAW_TYPE, 3>>;
+
 
 // Plugin class. This shall be the only part that needs to be modified,
 // implementing the actual functionality
@@ -37,6 +54,11 @@ class BufferedPlugin : public Source<json> {
 
 public:
 
+  // The acquisition thread calls into _acq: stop it first
+  ~BufferedPlugin() {
+    if (_acq) _acq->stop();
+  }
+
   // Typically, no need to change this
   string kind() override { return PLUGIN_NAME; }
 
@@ -45,28 +67,112 @@ public:
                          std::vector<unsigned char> *blob = nullptr) override {
     return_type result = return_type::success;
     out.clear();
-    out["data"] = json::array();
+    if (_publish_raw && !_trigger) out["data"] = json::array();
     if (!_agent_id.empty()) out["agent_id"] = _agent_id;
 
-    if (_acq->is_full()) {
-      auto data_copy = _acq->data();
-      _acq->fill_buffer_async();
-      json e = json::array();
-      // Fill the data section here
-      for (auto &sample : data_copy) {
-        e = sample.data;
-        e.insert(e.begin(), sample.time_since(_today));
-        out["data"].push_back(e);
+    // Batches are acquired continuously in a background thread and queued:
+    // take the oldest one, waiting for it if needed
+    RawAcquisitor::batch raw;
+    if (_capacity_ctl) adapt_capacity();
+    TIMING_START(t0);
+    if (!_queue->pop(raw)) {
+      _error = _acq->exhausted() ? "Replay finished" : "Acquisition stopped";
+      return return_type::error;
+    }
+    TIMING_RECORD(_t_wait, t0);
+    _last_pop = chrono::steady_clock::now();
+    _last_size = raw.size();
+    _last_span = raw.size() > 1 ? raw.back().time_since(raw.front().time) : 0;
+    // features are computed over whole batches, whose size may change
+    // (adaptive capacity, partial batches)
+    if (_features && _last_size != _features_capa) {
+      _features_capa = _last_size;
+      _features->resize(_decimator ? (_last_size + _decimator->factor() - 1) / _decimator->factor() : _last_size);
+    }
+#ifdef BUFFERED_TIMING
+    for (size_t i = 1; i < raw.size(); i++)
+      _t_interarrival.record(raw[i].time - raw[i - 1].time);
+#endif
+
+    // Raw batches go to the flight recorder first (memory writes only)
+    if (_recorder) _recorder->write(raw);
+
+    // Real sample count: with max_batch_latency_ms, batches can be partial
+    out["samples"] = raw.size();
+    if (_params["max_batch_latency_ms"] > 0) out["flushed"] = _acq->flushed();
+
+    // Processing runs here, while the next batch is being acquired, in
+    // engineering units (converted only if needed)
+    TIMING_START(t1);
+    Acquisitor<>::batch data_copy;
+    const bool publish_raw_units = _publish_raw && !_trigger && _raw_units;
+    if (_filters || _trigger || _decimator || _features || (_publish_raw && !_raw_units))
+      to_engineering(raw, data_copy, publish_raw_units);
+    // the filters are designed on the 1st batch, if the sample rate is
+    // not set: a cutoff above its Nyquist frequency is only detected here
+    if (_filters) {
+      try {
+        _filters->process(data_copy);
+      } catch (invalid_argument &e) {
+        _error = e.what();
+        return return_type::error;
       }
-    } else {
-      _acq->fill_buffer_async();
     }
-    if (!_acq->loading()) {
+    // triggers run at full rate, before decimation
+    vector<TriggerCapture<Acquisitor<>::sample>::Event> events;
+    if (_trigger) events = _trigger->process(data_copy);
+    if (_decimator) data_copy = _decimator->process(data_copy);
+    if (_features) out["features"] = _features->process(data_copy);
+    TIMING_RECORD(_t_process, t1);
+
+    // Fill the data section here; with a trigger, only the captured windows
+    // are published
+    TIMING_START(t2);
+    if (_trigger) {
+      out["events"] = json::array();
+      for (auto &ev : events) {
+        json ej = {
+          {"time", duration_cast<nanoseconds>(ev.time - _today).count() / 1.0E9},
+          {"pre", ev.pre},
+          {"data", json::array()}
+        };
+        package_raw(ev.samples, _today, ej["data"]);
+        out["events"].push_back(ej);
+      }
+      out["triggers"] = {{"events", _trigger->events()}, {"suppressed", _trigger->suppressed()}};
+    } else if (publish_raw_units) {
+      package_raw(raw, _today, out["data"]);
+    } else if (_publish_raw) {
+      package_raw(data_copy, _today, out["data"]);
+    }
+    TIMING_RECORD(_t_package, t2);
+
+    // Queue status; any new stall or loss means that packaging is slower
+    // than acquisition
+    out["queue"] = {
+      {"depth", _queue->size()},
+      {"high_water", _queue->high_water()},
+      {"dropped", _queue->dropped()},
+      {"decimated", _queue->decimated()},
+      {"stalls", _queue->stalls()}
+    };
+    if (_capacity_ctl) out["capacity"] = _acq->capa();
+    size_t overflows = _queue->dropped() + _queue->decimated() + _queue->stalls();
+    if (overflows > _overflows) {
+      _overflows = overflows;
       _error = "Warning: packaging data is slower than acquiring data";
       cerr << _error << endl;
       result = return_type::warning;
     }
-    _acq->wait();
+
+#ifdef BUFFERED_TIMING
+    // Stage latencies every stats_every batches
+    size_t every = _params["stats_every"];
+    if (every > 0 && ++_batches % every == 0) out["stats"] = timing_stats();
+#endif
+    // nothing worth publishing in this batch
+    if (result == return_type::success && _trigger && events.empty() && !_features)
+      result = return_type::retry;
     return result;
   }
 
@@ -76,11 +182,99 @@ public:
     _params["mean"] = 10;
     _params["sd"] = 2;
     _params["tz_offset"] = 2;
+    _params["publish"] = "raw";
+    _params["decimation"] = 1;
+    _params["queue_depth"] = 4;
+    _params["overflow"] = "block";
+    _params["stats_every"] = 0;
+    _params["adaptive_capacity"] = false;
+    _params["max_batch_latency_ms"] = 0;
+    _params["trigger"] = "none";
+    _params["recorder_file"] = "";
+    _params["recorder_size_mb"] = 64;
+    _params["recorder_index"] = 4096;
+    _params["replay_file"] = "";
+    _params["replay_speed"] = 1.0;
+    _params["replay_loop"] = false;
+    _params["scale"] = 1.0;
+    _params["offset"] = 0.0;
+    _params["units"] = "scaled";
     _params.merge_patch(*(json *)params);
 
+    // adaptive_capacity = true: batch size adjusted within min_capacity and
+    // max_capacity, for which the acquisitor buffers are preallocated
+    if (_params["adaptive_capacity"].get<bool>()) {
+      _capacity_ctl = make_unique<CapacityController>(_params);
+      _params["max_capacity"] = _capacity_ctl->max_capacity();
+    } else {
+      _capacity_ctl.reset();
+    }
+    _last_pop = {};
+    _features_capa = _params["capacity"].get<size_t>();
+
+    // filters = [{type = ..., cutoff = ...}, ...]: biquad cascade
+    if (!_params.value("filters", json::array()).empty())
+      _filters = make_unique<BiquadCascade<Acquisitor<>::sample>>(_params);
+    else
+      _filters.reset();
+
+    // recorder_file: raw batches into a memory-mapped circular file
+    string rec_file = _params["recorder_file"];
+    _recorder.reset();
+    if (!rec_file.empty())
+      _recorder = make_unique<FlightRecorder<RawAcquisitor::sample>>(
+        rec_file, _params["recorder_size_mb"].get<size_t>() << 20,
+        _params["recorder_index"].get<size_t>());
+
+    // trigger = "level", "slope", or "rms": publish only windows around
+    // events
+    if (_params["trigger"] != "none")
+      _trigger = make_unique<TriggerCapture<Acquisitor<>::sample>>(_params);
+    else
+      _trigger.reset();
+
+    // decimation > 1 low-pass filters and downsamples each batch
+    size_t capacity = _params["capacity"].get<size_t>();
+    if (_params["decimation"].get<int>() > 1) {
+      _decimator = make_unique<Decimator<Acquisitor<>::sample>>(_params);
+      capacity = (capacity + _decimator->factor() - 1) / _decimator->factor();
+    } else {
+      _decimator.reset();
+    }
+
+    // publish = "raw", "features", or "both"
+    string publish = _params["publish"];
+    _publish_raw = (publish != "features");
+    if (publish == "features" || publish == "both")
+      _features = make_unique<FeatureExtractor>(_params, capacity);
+    else
+      _features.reset();
+
+    // scale and offset convert raw values to engineering units; units =
+    // "raw" publishes the data section as acquired
+    _scaling = make_unique<Scaling>(_params);
+    string units = _params["units"];
+    if (units != "scaled" && units != "raw")
+      throw invalid_argument("Unknown units: " + units);
+    _raw_units = (units == "raw");
+    if (_raw_units && (_filters || _decimator))
+      throw invalid_argument("units = \"raw\" is not compatible with filters and decimation");
+
     _today = floor<chrono::days>(chrono::system_clock::now()) - hours(_params["tz_offset"]);
-    _acq = make_unique<Acquisitor<>>(_params);
-    
+
+    // queue_depth batches at most; overflow = "block", "drop_oldest",
+    // "drop_newest", or "decimate"
+    if (_acq) _acq->stop();
+    _queue = make_unique<RawAcquisitor::queue>(
+      _params["queue_depth"].get<size_t>(),
+      overflow_policy_from_string(_params["overflow"]));
+    _overflows = 0;
+    // replay_file: a recorded capture (.rec or CSV) instead of the device
+    if (!_params["replay_file"].get<string>().empty())
+      _acq = make_unique<ReplayAcquisitor<array<BUFFERED_RAW_TYPE, 3>>>(_params);
+    else
+      _acq = make_unique<RawAcquisitor>(_params);
+    _acq->start(*_queue);
   }
 
   // Implement this method if you want to provide additional information
@@ -91,15 +285,82 @@ public:
     
     return {
       {"Capacity", to_string(_params["capacity"])},
-      {"TZ offset", to_string(_params["tz_offset"])}
+      {"TZ offset", to_string(_params["tz_offset"])},
+      {"Publish", _params["publish"]},
+      {"Units", _params["units"].get<string>() + (_scaling->identity() ? "" : ", scale " + _params["scale"].dump() + ", offset " + _params["offset"].dump())},
+      {"Filters", to_string(_params.value("filters", json::array()).size())},
+      {"Decimation", to_string(_params["decimation"])},
+      {"Adaptive capacity", _capacity_ctl ? to_string(_capacity_ctl->min_capacity()) + "-" + to_string(_capacity_ctl->max_capacity()) + ", target " + to_string(_params.value("target_latency_ms", 100.0)) + " ms" : "off"},
+      {"Trigger", _params["trigger"].get<string>()},
+      {"Recorder", _recorder ? _params["recorder_file"].get<string>() + " (" + to_string(_params["recorder_size_mb"]) + " MB)" : "off"},
+      {"Replay", _params["replay_file"].get<string>().empty() ? "off" : _params["replay_file"].get<string>() + " at " + to_string(_params["replay_speed"]) + "x" + (_params["replay_loop"].get<bool>() ? ", looping" : "")},
+      {"Max batch latency", _params["max_batch_latency_ms"] > 0 ? to_string(_params["max_batch_latency_ms"]) + " ms" : "off"},
+      {"Queue", to_string(_params["queue_depth"]) + " batches, overflow: " + _params["overflow"].get<string>()},
+#ifdef BUFFERED_TIMING
+      {"Timing", timing_stats().dump()}
+#else
+      {"Timing", "disabled at compile time"}
+#endif
     };
     
   };
 
 private:
   // Define the fields that are used to store internal resources
-  unique_ptr<Acquisitor<>> _acq;
+  unique_ptr<RawAcquisitor::queue> _queue;
+  size_t _overflows = 0;
+  unique_ptr<RawAcquisitor> _acq;
   chrono::time_point<chrono::system_clock, chrono::nanoseconds> _today;
+  unique_ptr<BiquadCascade<Acquisitor<>::sample>> _filters;
+  unique_ptr<FlightRecorder<RawAcquisitor::sample>> _recorder;
+  unique_ptr<TriggerCapture<Acquisitor<>::sample>> _trigger;
+  unique_ptr<Decimator<Acquisitor<>::sample>> _decimator;
+  unique_ptr<FeatureExtractor> _features;
+  bool _publish_raw = true;
+  unique_ptr<Scaling> _scaling;
+  bool _raw_units = false;
+  unique_ptr<CapacityController> _capacity_ctl;
+  chrono::steady_clock::time_point _last_pop;
+  size_t _last_size = 0, _features_capa = 0;
+  double _last_span = 0;
+
+  // Scaled batch in engineering units; with raw values already in double,
+  // the raw batch is scaled in place unless it is still needed (keep)
+  template <typename RawBatch>
+  void to_engineering(RawBatch &raw, Acquisitor<>::batch &eng, bool keep) {
+    if constexpr (is_same_v<RawBatch, Acquisitor<>::batch>) {
+      if (keep) eng = raw;
+      else eng = std::move(raw);
+      _scaling->apply(eng);
+    } else {
+      _scaling->apply(raw, eng);
+    }
+  }
+
+  // The consumer has been busy (processing, packaging, publishing) since the
+  // previous batch was taken: tell the controller, and set the capacity for
+  // the batch being filled
+  void adapt_capacity() {
+    if (_last_pop == chrono::steady_clock::time_point{}) return;
+    chrono::duration<double> busy = chrono::steady_clock::now() - _last_pop;
+    _acq->set_capa(_capacity_ctl->update(_last_size, _last_span, busy.count()));
+  }
+
+#ifdef BUFFERED_TIMING
+  // Stage latencies (the fill time is recorded by _acq)
+  LatencyHistogram _t_wait, _t_interarrival, _t_process, _t_package;
+  size_t _batches = 0;
+
+  json timing_stats() const {
+    json stats;
+    if (_acq) stats["fill"] = _acq->fill_time().to_json();
+    stats["interarrival"] = _t_interarrival.to_json();
+    stats["wait"] = _t_wait.to_json();
+    stats["process"] = _t_process.to_json();
+    stats["package"] = _t_package.to_json();
+    return stats;
+  }
+#endif
 };
 
 
@@ -132,6 +393,8 @@ int main(int argc, char const *argv[]) {
   params["capacity"] = 5;
   params["mean"] = 10;
   params["sd"] = 2;
+  params["publish"] = "both";
+  params["stats_every"] = 3;
 
   // Set the parameters
   plugin.set_params(&params);
@@ -0,0 +1,310 @@
+/*
+  ____                  _
+ | __ )  ___ _ __   ___| |__
+ |  _ \ / _ \ '_ \ / __| '_ \
+ | |_) |  __/ | | | (__| | | |
+ |____/ \___|_| |_|\___|_| |_|
+
+Micro- and pipeline benchmarks for acquisition, packaging and DSP, with
+results in JSON for regression comparison:
+  buffered_bench [-f filter] [-r repetitions] [-t min_time_s] [-o file.json]
+Each benchmark is calibrated to run for at least min_time seconds per
+repetition; the median, minimum and maximum time per operation over the
+repetitions are reported. Inputs come from a fixed seed, so that runs are
+repeatable.
+*/
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "acquisitor.hpp"
+#include "fft.h"
+#include "moving_window_stats.hpp"
+#include "recorder.hpp"
+#include "replay_acq.hpp"
+#include "serial_acq.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using json = nlohmann::json;
+
+// Keeps the compiler from optimizing away the benchmarked work
+static volatile double sink;
+
+class Bench {
+public:
+  string filter;
+  int reps = 5;
+  double min_time = 0.2;
+  json results = json::array();
+
+  // Time body(), which processes `items` items per call
+  template <typename Body>
+  void run(string const &name, json const &params, size_t items, Body body) {
+    run(name, params, items, nullptr, body);
+  }
+
+  // As above, with setup() called before each body() call and not timed
+  // (each call is then timed separately, so body() should take at least a
+  // few microseconds)
+  template <typename Setup, typename Body>
+  void run(string const &name, json const &params, size_t items, Setup setup,
+           Body body) {
+    if (!filter.empty() && name.find(filter) == string::npos) return;
+    // calibration: double the iterations until min_time is reached
+    size_t iters = 1;
+    double t;
+    while ((t = time_loop(iters, setup, body)) < min_time) {
+      iters = t > 0 ? max(iters * 2, (size_t)(iters * min_time / t * 1.2)) : iters * 2;
+    }
+    vector<double> ns;
+    for (int r = 0; r < reps; r++)
+      ns.push_back(time_loop(iters, setup, body) * 1e9 / iters);
+    sort(ns.begin(), ns.end());
+    double median = ns[ns.size() / 2];
+    results.push_back({
+      {"name", name},
+      {"params", params},
+      {"iterations", iters},
+      {"repetitions", reps},
+      {"ns_per_op", median},
+      {"ns_per_op_min", ns.front()},
+      {"ns_per_op_max", ns.back()},
+      {"items_per_s", items * 1e9 / median}
+    });
+    cerr << name << " " << params.dump() << ": " << median << " ns/op" << endl;
+  }
+
+private:
+  template <typename Setup, typename Body>
+  static double time_loop(size_t iters, Setup &setup, Body &body) {
+    if constexpr (is_null_pointer_v<Setup>) {
+      auto t0 = steady_clock::now();
+      for (size_t i = 0; i < iters; i++) body();
+      return duration<double>(steady_clock::now() - t0).count();
+    } else {
+      duration<double> total{0};
+      for (size_t i = 0; i < iters; i++) {
+        setup();
+        auto t0 = steady_clock::now();
+        body();
+        total += steady_clock::now() - t0;
+      }
+      return total.count();
+    }
+  }
+};
+
+
+// FFT spectrum and peak search on a noisy multi-tone signal
+static void bench_fft(Bench &b) {
+  for (index_t p = 8; p <= 14; p += 2) {
+    const size_t n = (size_t)1 << p;
+    mt19937 gen(1);
+    normal_distribution<double> noise(0, 0.1);
+    vector<double> signal(n);
+    for (size_t i = 0; i < n; i++)
+      signal[i] = sin(2 * M_PI * 50 * i / 1000.0) +
+                  0.5 * sin(2 * M_PI * 120 * i / 1000.0) + noise(gen);
+    fft_data_t *d = fft_init(p, 1000.0);
+    auto load = [&] {
+      fft_reset(d);
+      for (size_t i = 0; i < n; i++) fft_add_point(d, signal[i], 0);
+      fft_apply_window_and_bias(d, hann);
+    };
+    b.run("fft_calc_spectrum", {{"n", n}}, n, load,
+          [&] { sink = fft_calc_spectrum(d); });
+    load();
+    fft_calc_spectrum(d);
+    fft_set_win_size(d, 10);
+    fft_set_nsigma(d, 2.0);
+    b.run("fft_search_peaks", {{"n", n}, {"max_peaks", 5}}, n / 2,
+          [&] { sink = fft_search_peaks(d, 5); });
+    fft_free(d);
+  }
+}
+
+// Zoom FFT of 256 bins over 1/zoom of the spectrum, loading included (it
+// demodulates and decimates), for comparison with the plain FFT of the same
+// number of samples
+static void bench_fft_zoom(Bench &b) {
+  const double freq = 1000.0;
+  for (size_t zoom : {16, 64}) {
+    const size_t len = 256 * zoom;
+    mt19937 gen(5);
+    normal_distribution<double> noise(0, 0.1);
+    vector<double> signal(len);
+    for (size_t i = 0; i < len; i++)
+      signal[i] = sin(2 * M_PI * 100.3 * i / freq) + noise(gen);
+    fft_data_t *d = fft_zoom_init(8, freq, 100.0, freq / zoom);
+    b.run("fft_zoom", {{"n", 256}, {"zoom", zoom}, {"samples", len}}, len, [&] {
+      fft_reset(d);
+      for (size_t i = 0; i < len; i++) fft_add_point(d, signal[i], 0);
+      fft_apply_window_and_bias(d, hann);
+      sink = fft_calc_spectrum(d);
+    });
+    fft_free(d);
+  }
+}
+
+// MovingWindowStats::add, with ACF and spectrum at each sample (hop = 1) and
+// only on demand
+static void bench_mws(Bench &b) {
+  mt19937 gen(2);
+  normal_distribution<double> noise(0, 1);
+  vector<double> values(1 << 16);
+  for (auto &v : values) v = noise(gen);
+  for (size_t w : {16, 64, 256, 1024, 4096}) {
+    for (size_t hop : {(size_t)1, MovingWindowStats::on_demand}) {
+      MovingWindowStats mws(w, hop);
+      auto h = mws.channel("x");
+      for (size_t i = 0; i < w; i++) mws.add(h, values[i]);
+      size_t i = 0;
+      b.run("mws_add", {{"window", w}, {"hop", hop}}, 1, [&] {
+        mws.add(h, values[i++ & (values.size() - 1)]);
+      });
+      sink = mws.mean(h);
+    }
+  }
+}
+
+// SerialportAcquisitor line parsing
+static void bench_serial_parse(Bench &b) {
+  string line = R"({"millis":123456,"data":{"AI1":512.25,"AI2":-3.125,"AI3":1023.0}})";
+  b.run("serial_parse", {{"bytes", line.size()}}, 1,
+        [&] { sink = SerialportAcquisitor::parse(line).data[0]; });
+}
+
+// Raw packaging as in get_output(), and its serialization to a string (as
+// done when publishing), for a given value type and number of channels
+template <typename V, size_t N>
+static void bench_package(Bench &b, string const &type) {
+  using Acq = Acquisitor<array<V, N>>;
+  mt19937 gen(3);
+  normal_distribution<double> noise(0, 1);
+  auto t0 = floor<days>(system_clock::now());
+  for (size_t capa : {10, 100, 1000, 10000}) {
+    typename Acq::batch batch(capa);
+    for (size_t i = 0; i < capa; i++) {
+      batch[i].time = t0 + microseconds(1000 * i);
+      for (auto &v : batch[i].data) v = (V)(is_integral_v<V> ? 1000 * noise(gen) : noise(gen));
+    }
+    json params = {{"capacity", capa}, {"channels", N}, {"type", type}};
+    b.run("package_raw", params, capa, [&] {
+      json rows = json::array();
+      package_raw(batch, t0, rows);
+      sink = rows.size();
+    });
+    b.run("package_raw_dump", params, capa, [&] {
+      json out;
+      out["data"] = json::array();
+      package_raw(batch, t0, out["data"]);
+      sink = out.dump().size();
+    });
+  }
+}
+
+// Hardware-free pipeline: a capture replayed as fast as possible (looping)
+// by the acquisition thread, with batches popped from the queue and packaged
+// as in get_output(), from a flight recording and from a CSV file
+static void bench_replay(Bench &b) {
+  using Acq = Acquisitor<>;
+  auto dir = filesystem::temp_directory_path();
+  string rec_file = (dir / "buffered_bench.rec").string();
+  string csv_file = (dir / "buffered_bench.csv").string();
+  mt19937 gen(4);
+  normal_distribution<double> noise(0, 1);
+  auto t0 = floor<days>(system_clock::now());
+  {
+    filesystem::remove(rec_file);
+    FlightRecorder<Acq::sample> rec(rec_file, 16 << 20, 1024);
+    ofstream csv(csv_file);
+    csv << "time,x,y,z\n";
+    Acq::batch batch(1000);
+    for (size_t k = 0; k < 100; k++) {
+      for (size_t i = 0; i < batch.size(); i++) {
+        batch[i].time = t0 + microseconds(1000 * (k * batch.size() + i));
+        for (auto &v : batch[i].data) v = noise(gen);
+        csv << batch[i].time_since(t0) << "," << batch[i].data[0] << ","
+            << batch[i].data[1] << "," << batch[i].data[2] << "\n";
+      }
+      rec.write(batch);
+    }
+  }
+  for (string file : {rec_file, csv_file}) {
+    for (size_t capa : {100, 1000}) {
+      json settings = {{"replay_file", file}, {"replay_speed", 0},
+                       {"replay_loop", true}, {"capacity", capa}};
+      Acq::queue q(4, overflow_policy::block);
+      ReplayAcquisitor<> acq(settings);
+      acq.start(q);
+      Acq::batch batch;
+      json params = {{"format", file == rec_file ? "rec" : "csv"}, {"capacity", capa}};
+      b.run("replay_package", params, capa, [&] {
+        q.pop(batch);
+        json rows = json::array();
+        package_raw(batch, t0, rows);
+        sink = rows.size();
+      });
+      acq.stop();
+    }
+  }
+  filesystem::remove(rec_file);
+  filesystem::remove(csv_file);
+}
+
+
+int main(int argc, char const *argv[]) {
+  Bench b;
+  string out_file;
+  for (int i = 1; i < argc; i += 2) {
+    string opt = argv[i];
+    if (i + 1 < argc && opt == "-f") b.filter = argv[i + 1];
+    else if (i + 1 < argc && opt == "-r") b.reps = max(1, atoi(argv[i + 1]));
+    else if (i + 1 < argc && opt == "-t") b.min_time = atof(argv[i + 1]);
+    else if (i + 1 < argc && opt == "-o") out_file = argv[i + 1];
+    else {
+      cerr << "Usage: " << argv[0]
+           << " [-f filter] [-r repetitions] [-t min_time_s] [-o file.json]"
+           << endl;
+      return 1;
+    }
+  }
+
+  bench_fft(b);
+  bench_fft_zoom(b);
+  bench_mws(b);
+  bench_serial_parse(b);
+  bench_package<double, 1>(b, "double");
+  bench_package<double, 3>(b, "double");
+  bench_package<double, 6>(b, "double");
+  bench_package<double, 12>(b, "double");
+  bench_package<int16_t, 3>(b, "int16");
+  bench_replay(b);
+
+  json report = {
+    {"timestamp", duration_cast<seconds>(system_clock::now().time_since_epoch()).count()},
+#ifdef __VERSION__
+    {"compiler", __VERSION__},
+#endif
+#ifdef NDEBUG
+    {"optimized", true},
+#else
+    {"optimized", false},
+#endif
+    {"min_time", b.min_time},
+    {"benchmarks", b.results}
+  };
+  if (out_file.empty()) {
+    cout << report.dump(2) << endl;
+  } else {
+    ofstream(out_file) << report.dump(2) << endl;
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+/*
+   ____                       _ _
+  / ___|__ _ _ __   __ _  ___(_) |_ _   _
+ | |   / _` | '_ \ / _` |/ __| | __| | | |
+ | |__| (_| | |_) | (_| | (__| | |_| |_| |
+  \____\__,_| .__/ \__,_|\___|_|\__|\__, |
+            |_|                     |___/
+Adaptive batch capacity: after each batch, picks the capacity of the next
+ones from the measured sample period and consumer time (processing,
+packaging and publishing). The capacity gives a batch duration as close as
+possible to the target latency, but never so short that the consumer cannot
+keep up, i.e. busy time <= headroom * batch duration. The busy time is
+modelled as a + b * capacity, fitted online with exponential forgetting.
+Configured by the plugin settings:
+  adaptive_capacity = true
+  min_capacity      = 10     # bounds (default: capacity / 10 and
+  max_capacity      = 1000   # capacity * 10)
+  target_latency_ms = 100.0  # desired batch duration
+  headroom          = 0.8    # max fraction of a batch duration spent busy
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <nlohmann/json.hpp>
+
+class CapacityController {
+public:
+  using json = nlohmann::json;
+
+  CapacityController(json const &settings) {
+    size_t capa = settings.value("capacity", 100);
+    _min = std::max<size_t>(1, settings.value("min_capacity", capa / 10));
+    _max = std::max(_min, settings.value("max_capacity", capa * 10));
+    _capacity = std::clamp(capa, _min, _max);
+    _target = settings.value("target_latency_ms", 100.0) / 1000.0;
+    _headroom = settings.value("headroom", 0.8);
+  }
+
+  size_t capacity() const { return _capacity; }
+  size_t min_capacity() const { return _min; }
+  size_t max_capacity() const { return _max; }
+  double period() const { return _period; }
+
+  // Feed the measurements of a batch of n samples acquired over span
+  // seconds, which kept the consumer busy for busy seconds; returns the
+  // capacity for the next batches
+  size_t update(size_t n, double span, double busy) {
+    if (n < 2 || span <= 0) return _capacity;
+    const double T = span / (n - 1);
+    _period = _period > 0 ? _period + ALPHA * (T - _period) : T;
+    // exponentially weighted least squares of busy = a + b n
+    _sw = (1 - ALPHA) * _sw + 1;
+    _sn = (1 - ALPHA) * _sn + n;
+    _sp = (1 - ALPHA) * _sp + busy;
+    _snn = (1 - ALPHA) * _snn + double(n) * n;
+    _snp = (1 - ALPHA) * _snp + n * busy;
+    double a, b;
+    const double var = _snn / _sw - (_sn / _sw) * (_sn / _sw);
+    const double mn = _sn / _sw;
+    if (var > 0.01 * mn * mn) { // enough spread in n to tell a from b
+      b = std::max(0.0, (_snp / _sw - mn * _sp / _sw) / var);
+      a = std::max(0.0, _sp / _sw - b * mn);
+    } else { // conservatively, all fixed cost
+      a = _sp / _sw;
+      b = 0;
+    }
+
+    // latency target, then the smallest capacity the consumer can keep up
+    // with: a + b n <= headroom n T
+    double want = _target / _period;
+    const double margin = _headroom * _period - b;
+    double need = margin > 0 ? a / margin : double(_max);
+    want = std::max(want, need);
+    // move by at most a factor of 2 per step, and ignore changes below 10%
+    // unless needed to keep up
+    want = std::clamp(want, _capacity / 2.0, _capacity * 2.0);
+    size_t next = std::clamp((size_t)std::ceil(want), _min, _max);
+    if (std::abs(double(next) - double(_capacity)) > 0.1 * _capacity ||
+        (next > _capacity && need > _capacity))
+      _capacity = next;
+    return _capacity;
+  }
+
+private:
+  static constexpr double ALPHA = 0.2;
+  size_t _min, _max, _capacity;
+  double _target, _headroom;
+  double _period = 0;
+  double _sw = 0, _sn = 0, _sp = 0, _snn = 0, _snp = 0;
+};
@@ -0,0 +1,100 @@
+/*
+  ____            _                 _
+ |  _ \  ___  ___(_)_ __ ___   __ _| |_ ___  _ __
+ | | | |/ _ \/ __| | '_ ` _ \ / _` | __/ _ \| '__|
+ | |_| |  __/ (__| | | | | | | (_| | || (_) | |
+ |____/ \___|\___|_|_| |_| |_|\__,_|\__\___/|_|
+
+Anti-aliased decimation of acquisition batches: low-pass FIR filter (windowed
+sinc, designed from the decimation factor) evaluated only for the samples
+that are kept, i.e. L/D multiply-adds per input sample, as a polyphase
+decimator. The filter history is kept across batches, so batch edges are
+seamless. Output timestamps are corrected for the filter delay.
+Configured by the plugin settings:
+  decimation       = 4   # output one sample every `decimation` (1: off)
+  decimation_taps  = 8   # filter taps per polyphase branch
+  decimation_cutoff = 0.8 # passband edge, fraction of the output Nyquist
+*/
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Sample is an Acquisitor<T>::sample, with T an array-like container of
+// scalars; all the channels are filtered together, so that the inner loop
+// runs (and vectorizes) across channels
+template <typename Sample>
+class Decimator {
+public:
+  using json = nlohmann::json;
+
+  Decimator(json const &settings) {
+    _factor = settings.value("decimation", 1);
+    if (_factor < 1) _factor = 1;
+    size_t taps = settings.value("decimation_taps", 8);
+    double cutoff = settings.value("decimation_cutoff", 0.8);
+    design(taps * _factor + 1, cutoff * 0.5 / _factor);
+  }
+
+  size_t factor() const { return _factor; }
+  size_t taps() const { return _h.size(); }
+
+  // Filter and decimate a batch; the returned samples have the timestamp of
+  // the input sample at the center of the filter
+  std::vector<Sample> process(std::vector<Sample> const &batch) {
+    std::vector<Sample> out;
+    out.reserve(batch.size() / _factor + 1);
+    const size_t L = _h.size();
+    for (auto const &s : batch) {
+      // history stored twice, so that the last L samples are always
+      // contiguous: _hist[_pos + 1 .. _pos + L], oldest first
+      _pos = (_pos + 1) % L;
+      _hist[_pos] = _hist[_pos + L] = s;
+      if (_filled < L) _filled++;
+      if (++_phase < _factor) continue;
+      _phase = 0;
+      if (_filled < L) continue; // not enough history yet
+      Sample const *w = &_hist[_pos + 1];
+      Sample y = w[L / 2];       // center sample: output timestamp
+      for (auto &v : y.data) v = 0;
+      for (size_t k = 0; k < L; k++) {
+        const double h = _h[k];
+        for (size_t c = 0; c < y.data.size(); c++)
+          y.data[c] += h * w[k].data[c];
+      }
+      out.push_back(y);
+    }
+    return out;
+  }
+
+  void reset() {
+    _filled = _phase = 0;
+    _pos = 0;
+  }
+
+private:
+  size_t _factor = 1;
+  std::vector<double> _h;
+  std::vector<Sample> _hist;
+  size_t _pos = 0, _filled = 0, _phase = 0;
+
+  // Windowed-sinc low-pass with L taps (odd, symmetric: linear phase with a
+  // delay of (L-1)/2 samples), cutoff fc in units of the input sample rate,
+  // Blackman window, unity gain at DC
+  void design(size_t L, double fc) {
+    _h.resize(L);
+    _hist.assign(2 * L, Sample{});
+    double sum = 0;
+    const double m = (L - 1) / 2.0;
+    for (size_t k = 0; k < L; k++) {
+      double t = k - m;
+      double sinc = t == 0 ? 2 * fc : std::sin(2 * M_PI * fc * t) / (M_PI * t);
+      double w = 0.42 - 0.5 * std::cos(2 * M_PI * k / (L - 1)) +
+                 0.08 * std::cos(4 * M_PI * k / (L - 1));
+      _h[k] = sinc * w;
+      sum += _h[k];
+    }
+    for (auto &h : _h) h /= sum;
+  }
+};
@@ -0,0 +1,191 @@
+/*
+  _____          _
+ |  ___|__  __ _| |_ _   _ _ __ ___  ___
+ | |_ / _ \/ _` | __| | | | '__/ _ \/ __|
+ |  _|  __/ (_| | |_| |_| | | |  __/\__ \
+ |_|  \___|\__,_|\__|\__,_|_|  \___||___/
+
+On-device feature extraction for the buffered plugins: reduces a whole
+acquisition batch to a few numbers per channel, so that features rather than
+raw samples can be published.
+Configured by the plugin settings:
+  features     = ["stats", "peaks", "acf"] # groups to compute
+  channels     = ["x", "y", "z"]           # names (default: ch0, ch1, ...)
+  sample_rate  = 1000.0                    # Hz (default: from timestamps)
+  fft_power    = 8                         # FFT size 2^power, up to 15
+                                           # (default: largest fitting the
+                                           # batch)
+  fft_window   = "hann"                    # hann, hamming, blackmann, none
+  fft_peaks    = 5                         # max number of peaks
+  fft_win_size = 10                        # peak search window (bins)
+  fft_nsigma   = 2.0                       # peak search threshold
+  fft_zoom_center    = 0.0                 # Hz, zoom FFT band center
+  fft_zoom_bandwidth = 0.0                 # Hz, zoom FFT band (0: off)
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "fft.h"
+#include "moving_window_stats.hpp"
+
+class FeatureExtractor {
+public:
+  using json = nlohmann::json;
+
+  FeatureExtractor(json const &settings, size_t capacity)
+      : _stats(capacity, MovingWindowStats::on_demand) {
+    for (auto const &f : settings.value("features", json::array({"stats", "peaks", "acf"}))) {
+      if (f == "stats") _do_stats = true;
+      else if (f == "peaks") _do_peaks = true;
+      else if (f == "acf") _do_acf = true;
+    }
+    if (settings.contains("channels"))
+      _names = settings["channels"].get<std::vector<std::string>>();
+    _sample_rate = settings.value("sample_rate", 0.0);
+    int power = settings.value("fft_power", 0);
+    if (power < 0 || power > MAX_POWER)
+      throw std::invalid_argument("fft_power must be between 0 (automatic) and " + std::to_string(MAX_POWER));
+    _fft_power = (index_t)power;
+    _auto_power = (_fft_power == 0);
+    resize(capacity);
+    std::string w = settings.value("fft_window", "hann");
+    if (w == "hann") _window = hann;
+    else if (w == "hamming") _window = hamming;
+    else if (w == "blackmann") _window = blackmann;
+    else _window = nullptr;
+    _max_peaks = settings.value("fft_peaks", 5);
+    _win_size = settings.value("fft_win_size", 10);
+    _nsigma = settings.value("fft_nsigma", 2.0);
+    _zoom_center = settings.value("fft_zoom_center", 0.0);
+    _zoom_bandwidth = settings.value("fft_zoom_bandwidth", 0.0);
+  }
+
+  // Change the batch size; with automatic FFT size, it is updated to the
+  // largest power of 2 fitting the batch, up to 2^15
+  void resize(size_t capacity) {
+    _stats.reset(capacity);
+    if (_auto_power) {
+      _fft_power = 0;
+      while (_fft_power < MAX_POWER && ((size_t)2 << _fft_power) <= capacity) _fft_power++;
+    }
+  }
+
+  // Compute the features of a batch (e.g. Acquisitor<T>::data()), returning
+  // an object with one entry per channel
+  template <typename Sample>
+  json process(std::vector<Sample> const &batch) {
+    json out = json::object();
+    if (batch.size() < 2) return out;
+    size_t n_ch = batch[0].data.size();
+    while (_handles.size() < n_ch) {
+      if (_names.size() <= _handles.size())
+        _names.push_back("ch" + std::to_string(_handles.size()));
+      _handles.push_back(_stats.channel(_names[_handles.size()]));
+    }
+    double rate = _sample_rate;
+    if (rate <= 0) {
+      double span = batch.back().time_since(batch.front().time);
+      rate = span > 0 ? (batch.size() - 1) / span : 1.0;
+    }
+
+    _stats.add_batch(batch, _handles);
+    for (size_t c = 0; c < n_ch; c++) {
+      json &f = out[_names[c]];
+      auto h = _handles[c];
+      if (_do_stats) {
+        f["mean"] = _stats.mean(h);
+        f["stdev"] = _stats.stdev(h);
+        f["rms"] = _stats.rms(h);
+        f["min"] = _stats.min(h);
+        f["max"] = _stats.max(h);
+        f["peak_to_peak"] = _stats.peak_to_peak(h);
+        f["crest_factor"] = _stats.crest_factor(h);
+        f["skewness"] = _stats.skewness(h);
+        f["kurtosis"] = _stats.kurtosis(h);
+      }
+      if (_do_peaks) f["peaks"] = peaks(batch, c, rate);
+      if (_do_acf) f["acf"] = acf_features(h, rate);
+    }
+    return out;
+  }
+
+private:
+  // largest FFT size whose bin indices fit index_t (uint16_t)
+  static constexpr int MAX_POWER = 15;
+  MovingWindowStats _stats;
+  std::vector<MovingWindowStats::handle> _handles;
+  std::vector<std::string> _names;
+  bool _do_stats = false, _do_peaks = false, _do_acf = false;
+  double _sample_rate;
+  index_t _fft_power;
+  bool _auto_power;
+  fft_windowing _window;
+  index_t _max_peaks, _win_size;
+  double _nsigma;
+  double _zoom_center, _zoom_bandwidth; // zoom FFT band (bandwidth 0: off)
+  std::unique_ptr<fft_data_t, void (*)(fft_data_t *)> _fft{nullptr, fft_free};
+  double _fft_rate = 0;
+
+  // Spectrum peaks of channel c over the first 2^power samples, as a list of
+  // [frequency, amplitude] pairs (interpolated below bin resolution); with
+  // zoom, 2^power bins over the zoom band, from 2^power * zoom samples (with
+  // automatic size, as many as fit the batch)
+  template <typename Sample>
+  json peaks(std::vector<Sample> const &batch, size_t c, double rate) {
+    json result = json::array();
+    size_t zoom = 1; // as in fft_zoom_init()
+    if (_zoom_bandwidth > 0 && rate / _zoom_bandwidth >= 1)
+      zoom = (size_t)(rate / _zoom_bandwidth);
+    index_t power = _fft_power;
+    if (_auto_power && _zoom_bandwidth > 0) {
+      power = 0;
+      while (power < MAX_POWER && ((size_t)2 << power) * zoom <= batch.size()) power++;
+    }
+    size_t n = (size_t)1 << power;
+    if (batch.size() < n * zoom) return result;
+    // frequencies are fixed at init: rebuild only if size or rate change
+    if (!_fft || fft_n(_fft.get()) != n ||
+        std::abs(rate - _fft_rate) > 1e-3 * _fft_rate) {
+      _fft.reset(_zoom_bandwidth > 0 ? fft_zoom_init(power, rate, _zoom_center, _zoom_bandwidth)
+                                     : fft_init(power, rate));
+      fft_set_win_size(_fft.get(), _win_size);
+      fft_set_nsigma(_fft.get(), _nsigma);
+      _fft_rate = rate;
+    }
+    fft_data_t *d = _fft.get();
+    fft_reset(d);
+    for (size_t i = 0; i < n * zoom; i++) fft_add_point(d, batch[i].data[c], 0);
+    if (_window) fft_apply_window_and_bias(d, _window);
+    fft_calc_spectrum(d);
+    index_t np = fft_search_peaks(d, _max_peaks);
+    for (index_t i = 0; i < np; i++)
+      result.push_back({fft_peaks_f(d)[i], fft_peaks_a(d)[i]});
+    return result;
+  }
+
+  // Periodicity from the ACF: the highest local maximum after the first zero
+  // crossing gives the dominant period and how periodic the signal is
+  json acf_features(MovingWindowStats::handle h, double rate) {
+    auto const &acf = _stats.acf(h);
+    json result = {{"period", 0.0}, {"periodicity", 0.0}};
+    size_t lag = 1;
+    while (lag < acf.size() && acf[lag] > 0) lag++;
+    size_t best = 0;
+    for (; lag + 1 < acf.size(); lag++) {
+      if (acf[lag] > 0 && acf[lag] > acf[lag - 1] && acf[lag] >= acf[lag + 1] &&
+          (best == 0 || acf[lag] > acf[best]))
+        best = lag;
+    }
+    if (best > 0) {
+      result["period"] = best / rate;
+      result["periodicity"] = acf[best];
+    }
+    return result;
+  }
+};
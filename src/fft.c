@@ -41,6 +41,7 @@
 #include "fft.h"
 
 const data_t PI2 = 2 * M_PI;
+#define ZOOM_TAPS 8 // zoom anti-aliasing filter taps per output point
 
 typedef struct fft_data {
   int processed;
@@ -51,6 +52,7 @@ typedef struct fft_data {
   data_t *f;      // freqs
   data_t mean[2];
   data_t sd[2];
+  data_t m2[2];   // sums of squared deviations from mean (Welford)
   index_t head;
   // Peaksearch
   data_t   nsigma;      // number of nsigma defining the threshold
@@ -58,7 +60,20 @@ typedef struct fft_data {
   data_t   stdev;       // search_peaks() will put here the overal st.dev.
   index_t *peaks;       // array of found peaks
   index_t  n_peaks;     // number of found peaks
+  data_t  *peaks_f;     // interpolated frequencies of found peaks
+  data_t  *peaks_a;     // interpolated amplitudes of found peaks
+  fft_windowing window; // last applied window (NULL: rectangular)
   char    *output_file; // debug output file (not used if NULL)
+  // Zoom FFT
+  size_t   zoom;        // decimation factor (0: no zoom)
+  data_t   center;      // center frequency
+  data_t   rot[2];      // oscillator step: cos, sin(2 pi center / freq)
+  data_t   osc[2];      // oscillator: cos, sin of the current phase
+  data_t  *h;           // anti-aliasing low-pass filter
+  size_t   h_len;
+  data_t  *hx, *hy;     // input history, written twice (ring of h_len)
+  size_t   h_head;
+  size_t   count;       // input points since reset
 } fft_data_t;
 
 void hamming(data_t x[], data_t bias, index_t n) {
@@ -106,9 +121,12 @@ fft_data_t *fft_init(index_t power, data_t freq) {
   data->t = (data_t *)malloc(n * sizeof(data_t));
   data->f = (data_t *)malloc(n * sizeof(data_t));
   data->peaks = (index_t *)malloc(INITIAL_N_PEAKS * sizeof(index_t));
+  data->peaks_f = (data_t *)malloc(INITIAL_N_PEAKS * sizeof(data_t));
+  data->peaks_a = (data_t *)malloc(INITIAL_N_PEAKS * sizeof(data_t));
   data->output_file = NULL;
   if (data->x == NULL || data->y == NULL || data->t == NULL ||
-      data->f == NULL || data->peaks == NULL) {
+      data->f == NULL || data->peaks == NULL || data->peaks_f == NULL ||
+      data->peaks_a == NULL) {
     perror("data malloc error");
     exit(EXIT_FAILURE);
   }
@@ -121,29 +139,89 @@ fft_data_t *fft_init(index_t power, data_t freq) {
   return data;
 }
 
+fft_data_t *fft_zoom_init(index_t power, data_t freq, data_t center, data_t bandwidth) {
+  size_t i, len;
+  data_t fc, sum = 0, rate;
+  fft_data_t *data = fft_init(power, freq);
+  data->zoom = bandwidth > 0 && freq / bandwidth >= 1 ? (size_t)(freq / bandwidth) : 1;
+  data->center = center;
+  rate = freq / data->zoom;
+  // windowed sinc (Blackman), passband edge at 80% of the output Nyquist
+  // frequency; with zoom 1 there is nothing to filter
+  len = data->zoom > 1 ? ZOOM_TAPS * data->zoom + 1 : 1;
+  data->h_len = len;
+  data->h = (data_t *)malloc(len * sizeof(data_t));
+  data->hx = (data_t *)malloc(2 * len * sizeof(data_t));
+  data->hy = (data_t *)malloc(2 * len * sizeof(data_t));
+  if (data->h == NULL || data->hx == NULL || data->hy == NULL) {
+    perror("data malloc error");
+    exit(EXIT_FAILURE);
+  }
+  fc = 0.4 / data->zoom;
+  for (i = 0; i < len; i++) {
+    const data_t m = i - (len - 1) / 2.0;
+    const data_t w = len > 1 ? 0.42 - 0.5 * cos(PI2 * i / (len - 1)) +
+                                   0.08 * cos(2 * PI2 * i / (len - 1))
+                             : 1;
+    data->h[i] = w * (m == 0 ? 2 * fc : sin(PI2 * fc * m) / (M_PI * m));
+    sum += data->h[i];
+  }
+  for (i = 0; i < len; i++) data->h[i] /= sum; // unit gain in the band
+  data->rot[0] = cos(PI2 * center / freq);
+  data->rot[1] = sin(PI2 * center / freq);
+  // bins in ascending frequency, from center - rate / 2
+  for (i = 0; i < data->n; i++) {
+    data->t[i] = i / rate;
+    data->f[i] = center + rate * ((data_t)i / data->n - 0.5);
+  }
+  fft_reset(data);
+  return data;
+}
+
 void fft_reset(fft_data_t *data) {
   memset(data->x, 0, data->n * sizeof(data_t));
   memset(data->y, 0, data->n * sizeof(data_t));
   memset(data->mean, 0, 2 * sizeof(data_t));
   data->processed = 0; // FFT NOT DONE YET!
   memset(data->sd, 0, 2 * sizeof(data_t));
+  memset(data->m2, 0, 2 * sizeof(data_t));
   data->head = 0;
+  data->window = NULL;
+  if (data->zoom) {
+    memset(data->hx, 0, 2 * data->h_len * sizeof(data_t));
+    memset(data->hy, 0, 2 * data->h_len * sizeof(data_t));
+    data->h_head = 0;
+    data->count = 0;
+    data->osc[0] = 1;
+    data->osc[1] = 0;
+  }
 }
 
 index_t *fft_realloc_peaks(fft_data_t *d, size_t n) {
-  d->peaks = (index_t*) realloc(fft_peaks(d), n * sizeof(index_t));
+  index_t *peaks = (index_t*) realloc(fft_peaks(d), n * sizeof(index_t));
+  data_t *peaks_f = (data_t*) realloc(d->peaks_f, n * sizeof(data_t));
+  data_t *peaks_a = (data_t*) realloc(d->peaks_a, n * sizeof(data_t));
+  if (peaks) d->peaks = peaks;
+  if (peaks_f) d->peaks_f = peaks_f;
+  if (peaks_a) d->peaks_a = peaks_a;
+  if (peaks == NULL || peaks_f == NULL || peaks_a == NULL) return NULL;
   return d->peaks;
 }
 
 void fft_free(fft_data_t *d) {
   assert(d != NULL);
-  // free(d->x);
-  // free(d->y);
-  // free(d->t);
+  free(d->x);
+  free(d->y);
+  free(d->t);
   free(d->f);
   free(d->peaks);
+  free(d->peaks_f);
+  free(d->peaks_a);
   if (d->output_file)
     free(d->output_file);
+  free(d->h);
+  free(d->hx);
+  free(d->hy);
   free(d);
 }
 
@@ -199,6 +277,87 @@ static void fft(data_t x[], data_t y[], index_t n) {
   return;
 }
 
+typedef struct fft_plan {
+  size_t  n;   // transform size: power of 2
+  size_t *rev; // bit-reversed index of each element
+  data_t *c;   // cos(2 pi k / n), k < n/2
+  data_t *s;   // -sin(2 pi k / n), k < n/2
+} fft_plan_t;
+
+fft_plan_t *fft_plan_init(index_t power) {
+  size_t i, j, n = (size_t)1 << power;
+  fft_plan_t *p = (fft_plan_t *)malloc(sizeof(fft_plan_t));
+  if (p == NULL) {
+    perror("fft_plan malloc error");
+    exit(EXIT_FAILURE);
+  }
+  p->n = n;
+  p->rev = (size_t *)malloc(n * sizeof(size_t));
+  p->c = (data_t *)malloc((n / 2 + 1) * sizeof(data_t));
+  p->s = (data_t *)malloc((n / 2 + 1) * sizeof(data_t));
+  if (p->rev == NULL || p->c == NULL || p->s == NULL) {
+    perror("fft_plan malloc error");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < n; i++) {
+    size_t r = 0;
+    for (j = 1; j < n; j <<= 1) {
+      r <<= 1;
+      if (i & j) r |= 1;
+    }
+    p->rev[i] = r;
+  }
+  for (i = 0; i < n / 2; i++) {
+    p->c[i] = cos(PI2 * i / n);
+    p->s[i] = -sin(PI2 * i / n);
+  }
+  return p;
+}
+
+void fft_plan_free(fft_plan_t *p) {
+  if (p == NULL) return;
+  free(p->rev);
+  free(p->c);
+  free(p->s);
+  free(p);
+}
+
+size_t fft_plan_n(const fft_plan_t *p) { return p->n; }
+
+// Same algorithm as fft() above, with tabulated twiddles
+void fft_plan_exec(const fft_plan_t *p, data_t x[], data_t y[]) {
+  const size_t n = p->n;
+  size_t i, j, k, n1, n2, step;
+  data_t c, s, t1, t2;
+  for (i = 0; i < n; i++) {
+    j = p->rev[i];
+    if (i < j) {
+      t1 = x[i];
+      x[i] = x[j];
+      x[j] = t1;
+      t1 = y[i];
+      y[i] = y[j];
+      y[j] = t1;
+    }
+  }
+  for (n2 = 2; n2 <= n; n2 <<= 1) {
+    n1 = n2 / 2;
+    step = n / n2;
+    for (j = 0; j < n1; j++) {
+      c = p->c[j * step];
+      s = p->s[j * step];
+      for (k = j; k < n; k += n2) {
+        t1 = c * x[k + n1] - s * y[k + n1];
+        t2 = s * x[k + n1] + c * y[k + n1];
+        x[k + n1] = x[k] - t1;
+        y[k + n1] = y[k] - t2;
+        x[k] = x[k] + t1;
+        y[k] = y[k] + t2;
+      }
+    }
+  }
+}
+
 // operate an in-place transform from rectangilar to polar coords
 void to_polar(data_t *const x, data_t *const y) {
   assert(x != NULL && y != NULL);
@@ -222,47 +381,103 @@ static void polar_fft(fft_data_t *const d) {
 void fft_apply_window(fft_data_t *const d, fft_windowing win) {
   win(d->x, 0.0, d->n);
   win(d->y, 0.0, d->n);
+  d->window = win;
 }
 
+// With zoom, the input bias is rejected by the demodulation filter, and the
+// mean of the demodulated points is signal (at the center frequency)
 void fft_apply_window_and_bias(fft_data_t *const d, fft_windowing win) {
-  win(d->x, d->mean[0], d->n);
-  win(d->y, d->mean[1], d->n);
+  win(d->x, d->zoom ? 0 : d->mean[0], d->n);
+  win(d->y, d->zoom ? 0 : d->mean[1], d->n);
+  d->window = win;
 }
 
 index_t fft_calc_spectrum(fft_data_t *const d) {
-  index_t n = d->n / 2;
-  if (d->processed == 0)
+  index_t i, h = d->n / 2;
+  data_t t;
+  if (d->processed == 0) {
     polar_fft(d);
-  return n;
+    // zoom: negative frequencies (upper half) first
+    for (i = 0; d->zoom && i < h; i++) {
+      t = d->x[i];
+      d->x[i] = d->x[i + h];
+      d->x[i + h] = t;
+      t = d->y[i];
+      d->y[i] = d->y[i + h];
+      d->y[i + h] = t;
+    }
+  }
+  return fft_nbins(d);
 }
 
-int fft_add_point(fft_data_t *const d, data_t x, data_t y) {
-  const index_t n = d->head + 1;
-  d->x[n] = x;
-  d->y[n] = y;
-  if (n <= 1) { // recursion formula: first element (base-1)
-    d->mean[0] = x;
-    d->mean[1] = y;
-    d->sd[0] = 0;
-    d->sd[1] = 0;
-  } else {
-    const data_t n1 = n - 1;
-    const data_t n2 = n - 2;
-    const data_t nr = 1.0 / n;
-    const data_t n1r = 1.0 / n1;
-    const data_t nn1 = n / n1;
-    d->mean[0] = nr * (n1 * d->mean[0] + x);
-    d->mean[1] = nr * (n1 * d->mean[1] + y);
-    d->sd[0] = sqrt(n1r *
-                    (n2 * pow(d->sd[0], 2) + nn1 * pow(d->mean[0] - x, 2)));
-    d->sd[1] = sqrt(n1r *
-                    (n2 * pow(d->sd[1], 2) + nn1 * pow(d->mean[1] - y, 2)));
+// Exact two-pass mean and standard deviation of the collected points
+static void exact_stats(fft_data_t *const d, data_t *v, int c) {
+  index_t i;
+  data_t sum = 0, acc = 0;
+  for (i = 0; i < d->head; i++) sum += v[i];
+  d->mean[c] = sum / d->head;
+  for (i = 0; i < d->head; i++) acc += (v[i] - d->mean[c]) * (v[i] - d->mean[c]);
+  d->m2[c] = acc;
+  d->sd[c] = d->head > 1 ? sqrt(acc / (d->head - 1)) : 0;
+}
+
+// Zoom: demodulate the input point, and filter the history into a new
+// point every zoom inputs; returns 1 when (x, y) holds a new point
+static int zoom_point(fft_data_t *const d, data_t *x, data_t *y) {
+  size_t i;
+  const size_t len = d->h_len;
+  const data_t c = d->osc[0], s = d->osc[1];
+  data_t ax = 0, ay = 0, g;
+  // (x + iy) e^(-i phase)
+  const data_t xr = *x * c + *y * s;
+  const data_t yr = *y * c - *x * s;
+  d->hx[d->h_head] = d->hx[d->h_head + len] = xr;
+  d->hy[d->h_head] = d->hy[d->h_head + len] = yr;
+  d->h_head = (d->h_head + 1) % len;
+  // recursive oscillator, kept on the unit circle
+  d->osc[0] = c * d->rot[0] - s * d->rot[1];
+  d->osc[1] = s * d->rot[0] + c * d->rot[1];
+  g = (3 - d->osc[0] * d->osc[0] - d->osc[1] * d->osc[1]) / 2;
+  d->osc[0] *= g;
+  d->osc[1] *= g;
+  if (++d->count % d->zoom != 0) return 0;
+  // the last len inputs are contiguous from h_head (h is symmetric)
+  for (i = 0; i < len; i++) {
+    ax += d->h[i] * d->hx[d->h_head + i];
+    ay += d->h[i] * d->hy[d->h_head + i];
   }
-  d->head++;
+  *x = ax;
+  *y = ay;
+  return 1;
+}
+
+int fft_add_point(fft_data_t *const d, data_t x, data_t y) {
+  const index_t n = d->head + 1; // number of points, this one included
+  data_t dx, dy;
   if (d->head >= d->n)
     return 0;
-  else
+  if (d->zoom && !zoom_point(d, &x, &y))
     return 1;
+  d->x[d->head] = x;
+  d->y[d->head] = y;
+  // Welford recursion: no cancellation, whatever the offset of the signal
+  dx = x - d->mean[0];
+  dy = y - d->mean[1];
+  d->mean[0] += dx / n;
+  d->mean[1] += dy / n;
+  d->m2[0] += dx * (x - d->mean[0]);
+  d->m2[1] += dy * (y - d->mean[1]);
+  d->head++;
+  if (d->head >= d->n) {
+    // buffer full: replace the running values with the exact ones, which are
+    // used by fft_apply_window_and_bias()
+    exact_stats(d, d->x, 0);
+    exact_stats(d, d->y, 1);
+    return 0;
+  }
+  d->sd[0] = n > 1 ? sqrt(d->m2[0] / (n - 1)) : 0;
+  d->sd[1] = n > 1 ? sqrt(d->m2[1] / (n - 1)) : 0;
+  return 1;
 }
 
 
@@ -271,11 +486,17 @@ data_t *fft_y(const fft_data_t *fft) { return fft->y; }
 data_t *fft_t(const fft_data_t *fft) { return fft->t; }
 data_t *fft_f(const fft_data_t *fft) { return fft->f; }
 index_t fft_n(const fft_data_t *fft) { return fft->n; }
+index_t fft_nbins(const fft_data_t *fft) { return fft->zoom ? fft->n : fft->n / 2; }
+size_t fft_zoom(const fft_data_t *fft) { return fft->zoom; }
+data_t fft_zoom_center(const fft_data_t *fft) { return fft->center; }
 index_t fft_win_size(const fft_data_t *fft) { return fft->win_size; }
 void fft_set_win_size(fft_data_t *fft, index_t w) { fft->win_size = w; }
 index_t fft_npeaks(const fft_data_t *fft) { return fft->n_peaks; }
 void fft_set_npeaks(fft_data_t *fft, index_t n) { fft->n_peaks = n;}
 index_t *fft_peaks(const fft_data_t *fft) { return fft->peaks; }
+data_t *fft_peaks_f(const fft_data_t *fft) { return fft->peaks_f; }
+data_t *fft_peaks_a(const fft_data_t *fft) { return fft->peaks_a; }
+fft_windowing fft_window(const fft_data_t *fft) { return fft->window; }
 char *fft_output_file(const fft_data_t *fft) { return fft->output_file; }
 void fft_set_output_file(fft_data_t *fft, const char *file) {
   fft->output_file = (char *)calloc(strlen(file) + 1, sizeof(char));
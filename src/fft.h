@@ -62,6 +62,13 @@ typedef struct fft_data fft_data_t;
 
 // Initializer&de-initializer
 fft_data_t *fft_init(index_t radix, data_t freq);
+// Zoom FFT: spectrum of the band around center only, with 2^radix bins over
+// freq / zoom, where zoom = floor(freq / bandwidth) (at least 1). Points are
+// added at the full rate freq: they are demodulated by center, low-pass
+// filtered and decimated by zoom, so that a transform takes 2^radix * zoom
+// points. The spectrum is ordered by frequency, as given by fft_f(), and
+// all its fft_nbins() bins are searched by fft_search_peaks()
+fft_data_t *fft_zoom_init(index_t radix, data_t freq, data_t center, data_t bandwidth);
 void fft_free(fft_data_t * d);
 void fft_reset(fft_data_t *d);
 index_t *fft_realloc_peaks(fft_data_t *d, size_t n);
@@ -77,16 +84,28 @@ void blackmann(data_t x[], data_t bias, index_t n);
 void fft_apply_window(fft_data_t * const d, fft_windowing w);
 void fft_apply_window_and_bias(fft_data_t * const d, fft_windowing w);
 
-// Calculate spectrum (in place: initial data are lost)
+// Calculate spectrum (in place: initial data are lost); returns the number
+// of useful bins (n / 2, or n with zoom)
 // NOTE: returns polar coordinates
 index_t fft_calc_spectrum(fft_data_t * const d);
 // Run peak search algorithm
 index_t fft_search_peaks(fft_data_t * const d, index_t max_peaks);
+// Refine found peaks below bin resolution (called by fft_search_peaks()):
+// fills fft_peaks_f() and fft_peaks_a() according to the applied window
+void fft_interpolate_peaks(fft_data_t * const d);
 
 // Utilities
 // operate an in-place transform from rectangilar to polar coords
 void to_polar(data_t * const x, data_t * const y);
 
+// Transform plan: twiddles and bit-reversal precomputed once, for repeated
+// in-place transforms of the same size (rectangular coords, no windowing)
+typedef struct fft_plan fft_plan_t;
+fft_plan_t *fft_plan_init(index_t power);
+void fft_plan_free(fft_plan_t *p);
+size_t fft_plan_n(const fft_plan_t *p);
+void fft_plan_exec(const fft_plan_t *p, data_t x[], data_t y[]);
+
 
 // Accessors
 
@@ -95,11 +114,17 @@ data_t *fft_y(const fft_data_t *fft);
 data_t *fft_t(const fft_data_t *fft);
 data_t *fft_f(const fft_data_t *fft);
 index_t fft_n(const fft_data_t *fft);
+index_t fft_nbins(const fft_data_t *fft); // useful spectrum bins
+size_t fft_zoom(const fft_data_t *fft);   // decimation factor (0: no zoom)
+data_t fft_zoom_center(const fft_data_t *fft);
 index_t fft_win_size(const fft_data_t *fft);
 void fft_set_win_size(fft_data_t *fft, index_t w);
 index_t fft_npeaks(const fft_data_t *fft);
 void fft_set_npeaks(fft_data_t *fft, index_t n);
 index_t *fft_peaks(const fft_data_t *fft);
+data_t *fft_peaks_f(const fft_data_t *fft);
+data_t *fft_peaks_a(const fft_data_t *fft);
+fft_windowing fft_window(const fft_data_t *fft);
 char *fft_output_file(const fft_data_t *fft);
 void fft_set_output_file(fft_data_t *fft, const char *file);
 data_t fft_stdev(const fft_data_t *fft);
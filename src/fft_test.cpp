@@ -1,10 +1,278 @@
 #include <iostream>
 #include <cmath>
+#include <random>
+#include <vector>
 #include "fft.h"
 #include "peaksearch.h"
+#include "peaktrack.h"
+#include "goertzel.h"
 
 using namespace std;
 
+// Reference O(n*w) peak search: the original two-pass, per-window algorithm
+// of the baseline, verbatim, on a buffer with guard slots so that its
+// out-of-bounds accesses (peaks[-1] on the first peak, peaks[max_peaks] when
+// full) are defined. It differs from fft_search_peaks() only when a cluster
+// re-finds the previous peak without finding a new one: the baseline counts
+// it anyway (leaving a stale entry), fft_search_peaks() does not. Such
+// inputs are flagged with diverges, and the count is capped at max_peaks
+static vector<index_t> reference_search_peaks(const data_t *x, index_t n,
+                                              index_t w, data_t nsigma,
+                                              index_t max_peaks,
+                                              bool &diverges) {
+  typedef struct statistics {
+    data_t  mean;
+    data_t  sd;
+    data_t  max;
+    index_t max_idx;
+  } statistics_t;
+  auto compute_stats = [&](index_t start, char type, statistics_t *const stat) {
+    data_t acc = 0., sum = 0.;
+    index_t i, c, end = 0;
+    switch (type) {
+      case FULL:
+        end = n;
+        break;
+      case PARTIAL:
+        end = start + w <= n ? start + w : n;
+        break;
+    }
+    for (i = start, c = 0; i < end; i++, c++) sum += x[i];
+    stat->mean = sum / c;
+    stat->max  = 0.;
+    for (i = start, c = 0; i < end; i++, c++) {
+      acc += pow((x[i] - stat->mean), 2);
+      if (x[i] > stat->max) {
+        stat->max     = x[i];
+        stat->max_idx = i;
+      }
+    }
+    stat->sd = sqrt(acc / (c - 1));
+  };
+  const index_t guard = (index_t)-1; // never a valid bin
+  vector<index_t> buffer(max_peaks + 3, guard);
+  index_t *peaks = buffer.data() + 1;
+  index_t count = 0;
+  statistics_t stat = {0., 0., 0., 0};
+  compute_stats(0, FULL, &stat);
+  const data_t stdev = stat.sd;
+  index_t i;
+  char in_cluster = 0, found = 0;
+  data_t max = 0.;
+  diverges = false;
+  for(i = 0; i < ((n / 2) - w); i++) {
+    compute_stats(i, PARTIAL, &stat);
+    if (stat.sd > nsigma * stdev) {
+      if (stat.max > max && peaks[count-1] != stat.max_idx) {
+        peaks[count] = stat.max_idx;
+        max = stat.max;
+        found = 1;
+      }
+      in_cluster = 1;
+    }
+    else {
+      if(in_cluster == 1) {
+        if (!found) diverges = true;
+        count++;
+      }
+      if(count > max_peaks) {
+        break;
+      }
+      max = 0.;
+      in_cluster = 0;
+      found = 0;
+    }
+  }
+  return vector<index_t>(peaks, peaks + std::min(count, max_peaks));
+}
+
+// Compare fft_search_peaks() with the reference on noisy multi-tone signals
+static bool check_peaksearch_equivalence() {
+  mt19937 gen(42);
+  normal_distribution<double> noise(0, 0.2);
+  bool ok = true;
+  size_t compared = 0;
+  for (size_t exp : {8, 10, 12}) {
+    for (index_t w : {3, 10, 25, 60}) {
+      fft_data_t *fft = fft_init(exp, 1000.0);
+      fft_set_win_size(fft, w);
+      fft_set_nsigma(fft, 1.5);
+      for (size_t i = 0; i < fft_n(fft); i++) {
+        double t = i / 1000.0;
+        fft_add_point(fft,
+                      5 + 2 * sin(t * 128 * 2 * M_PI) +
+                          0.8 * sin(t * 200 * 2 * M_PI) +
+                          0.3 * sin(t * 377 * 2 * M_PI) + noise(gen),
+                      0);
+      }
+      fft_apply_window_and_bias(fft, hann);
+      fft_calc_spectrum(fft);
+      bool diverges;
+      vector<index_t> ref = reference_search_peaks(
+          fft_x(fft), fft_n(fft), w, fft_nsigma(fft), 10, diverges);
+      index_t count = fft_search_peaks(fft, 10);
+      vector<index_t> got(fft_peaks(fft), fft_peaks(fft) + count);
+      compared += !diverges;
+      if (!diverges && got != ref) {
+        cout << "Peak search mismatch for n=" << fft_n(fft) << ", w=" << w
+             << ": " << count << " peaks vs " << ref.size() << endl;
+        ok = false;
+      }
+      fft_free(fft);
+    }
+  }
+  if (compared < 6) {
+    cout << "Peak search: only " << compared << " comparable inputs" << endl;
+    ok = false;
+  }
+  return ok;
+}
+
+// Check that interpolated peaks of a small transform locate off-bin tones
+// to a small fraction of the bin width, for each supported window
+static bool check_peak_interpolation() {
+  const double freq = 1000.0, f1 = 128.3, f2 = 200.7;
+  bool ok = true;
+  struct {
+    const char *name;
+    fft_windowing w;
+  } windows[] = {{"none", nullptr}, {"hann", hann},
+                 {"hamming", hamming}, {"blackmann", blackmann}};
+  for (auto &win : windows) {
+    fft_data_t *fft = fft_init(8, freq);
+    fft_set_win_size(fft, 6);
+    fft_set_nsigma(fft, 1);
+    for (size_t i = 0; i < fft_n(fft); i++) {
+      double t = i / freq;
+      fft_add_point(fft, 2 * sin(t * f1 * 2 * M_PI) + 0.8 * sin(t * f2 * 2 * M_PI), 0);
+    }
+    if (win.w) fft_apply_window_and_bias(fft, win.w);
+    fft_calc_spectrum(fft);
+    fft_search_peaks(fft, 10);
+    double df = freq / fft_n(fft), err = 0;
+    for (int i = 0; i < fft_npeaks(fft); i++) {
+      double f = fft_peaks_f(fft)[i];
+      err = max(err, min(fabs(f - f1), fabs(f - f2)) / df);
+    }
+    cout << "Window " << win.name << ": " << fft_npeaks(fft)
+         << " peaks, max error " << err << " bins" << endl;
+    if (fft_npeaks(fft) < 2 || err > 0.03) ok = false;
+    fft_free(fft);
+  }
+  return ok;
+}
+
+// Follow two tones, one of them drifting, across successive spectra: track
+// identities must stay the same and the drift must be followed
+static bool check_peak_tracking() {
+  const double freq = 1000.0;
+  const int frames = 40;
+  bool ok = true;
+  fft_data_t *fft = fft_init(8, freq);
+  fft_set_win_size(fft, 6);
+  fft_set_nsigma(fft, 1);
+  fft_tracker_t *tracker = fft_tracker_init(4, 2);
+  index_t rescans = 0;
+  for (int frame = 0; frame < frames; frame++) {
+    double f1 = 100.0 + 0.5 * frame, f2 = 300.0;
+    fft_reset(fft);
+    for (size_t i = 0; i < fft_n(fft); i++) {
+      double t = (frame * fft_n(fft) + i) / freq;
+      fft_add_point(fft, 2 * sin(t * f1 * 2 * M_PI) + sin(t * f2 * 2 * M_PI), 0);
+    }
+    fft_apply_window_and_bias(fft, hann);
+    fft_calc_spectrum(fft);
+    fft_tracker_update(tracker, fft);
+    rescans += fft_tracker_rescanned(tracker);
+    if (fft_tracker_ntracks(tracker) != 2) {
+      ok = false;
+      continue;
+    }
+    fft_track_t *tr = fft_tracker_tracks(tracker);
+    if (tr[0].id != 0 || tr[1].id != 1 ||
+        fabs(tr[0].freq - f1) > 0.5 || fabs(tr[1].freq - f2) > 0.5)
+      ok = false;
+  }
+  cout << "Tracked " << fft_tracker_ntracks(tracker) << " tones over "
+       << frames << " frames with " << rescans << " full searches" << endl;
+  fft_tracker_free(tracker);
+  fft_free(fft);
+  return ok;
+}
+
+// Amplitude and phase of known tones with a Goertzel bank, in block and in
+// sliding mode, on a window that is not a power of 2
+static bool check_goertzel() {
+  const double freq = 1000.0;
+  const index_t n = 200;
+  data_t targets[] = {50.0, 125.0, 300.0};
+  const double ampl[] = {2.0, 0.7, 0.0}, phase[] = {0.3, -1.2, 0.0};
+  bool ok = true;
+  for (int sliding : {0, 1}) {
+    goertzel_t *g = goertzel_init(targets, 3, freq, n, sliding);
+    size_t ready = 0, total = 10 * n + 37;
+    for (size_t i = 0; i < total; i++) {
+      double x = 1.5;
+      for (int k = 0; k < 3; k++)
+        x += ampl[k] * cos(2 * M_PI * targets[k] * i / freq + phase[k]);
+      if (!goertzel_add_point(g, x)) continue;
+      ready++;
+      // phase at the first sample of the window
+      size_t first = i + 1 - n;
+      for (int k = 0; k < 2; k++) {
+        double ph = fmod(phase[k] + 2 * M_PI * targets[k] * first / freq, 2 * M_PI);
+        double dph = remainder(goertzel_phase(g, k) - ph, 2 * M_PI);
+        if (fabs(goertzel_amplitude(g, k) - ampl[k]) > 1e-6 || fabs(dph) > 1e-6)
+          ok = false;
+      }
+      if (goertzel_amplitude(g, 2) > 1e-6) ok = false;
+    }
+    cout << "Goertzel (" << (sliding ? "sliding" : "block") << "): " << ready
+         << " results over " << total << " samples" << endl;
+    if (ready != (sliding ? total - n + 1 : total / n)) ok = false;
+    goertzel_free(g);
+  }
+  return ok;
+}
+
+// Resolve two tones 0.5 Hz apart around 1 kHz with a zoom FFT of 256 bins
+// (a plain FFT would need 2^17 points), rejecting a DC offset and a strong
+// tone out of the band
+static bool check_zoom_fft() {
+  const double freq = 10000.0, f1 = 1000.1, f2 = 1000.6;
+  const double a1 = 1.0, a2 = 0.5;
+  fft_data_t *fft = fft_zoom_init(8, freq, 1000.0, 20.0);
+  fft_set_win_size(fft, 3); // the tones are 6.4 bins apart
+  fft_set_nsigma(fft, 1);
+  size_t points = 0;
+  for (size_t i = 0; fft_add_point(fft, 3.0 + a1 * cos(2 * M_PI * f1 * i / freq) +
+                                            a2 * cos(2 * M_PI * f2 * i / freq) +
+                                            5.0 * cos(2 * M_PI * 1100.0 * i / freq), 0); i++)
+    points = i + 2;
+  fft_apply_window_and_bias(fft, hann);
+  index_t bins = fft_calc_spectrum(fft);
+  fft_search_peaks(fft, 10);
+  const double df = fft_f(fft)[1] - fft_f(fft)[0];
+  bool ok = fft_zoom(fft) == 500 && bins == 256 && points == 256 * 500 &&
+            fft_npeaks(fft) == 2;
+  // magnitudes are n/2 times the amplitude, as for the plain FFT; the Hann
+  // window halves them
+  const double scale = fft_n(fft) / 4.0;
+  for (int i = 0; ok && i < 2; i++) {
+    const double f = i == 0 ? f1 : f2, a = i == 0 ? a1 : a2;
+    if (fabs(fft_peaks_f(fft)[i] - f) > 0.1 * df ||
+        fabs(fft_peaks_a(fft)[i] / scale - a) > 0.02 * a)
+      ok = false;
+  }
+  cout << "Zoom FFT: " << fft_npeaks(fft) << " peaks over " << fft_f(fft)[0]
+       << "-" << fft_f(fft)[bins - 1] << " Hz, resolution " << df << " Hz:";
+  for (int i = 0; i < fft_npeaks(fft); i++)
+    cout << " " << fft_peaks_f(fft)[i] << " Hz (" << fft_peaks_a(fft)[i] / scale << ")";
+  cout << endl;
+  fft_free(fft);
+  return ok;
+}
+
 int main() {
   size_t exp = 10;
   size_t n = std::pow(2, exp);
@@ -17,7 +285,7 @@ int main() {
 
   double t, dt = 1.0 / freq;
   // fill signal
-  for (int i = 0; i < n; i++) {
+  for (size_t i = 0; i < n; i++) {
     t = i * dt;
     fft_add_point(fft, 2 * std::sin(t*128*2*M_PI) + 0.8 * std::sin(t*200*2*M_PI), 0);
   }
@@ -30,10 +298,27 @@ int main() {
     cout << "peak " << i << " at index " << fft_peaks(fft)[i]
          << " freq " << fft_f(fft)[fft_peaks(fft)[i]]
          << " value " << fft_x(fft)[fft_peaks(fft)[i]]
+         << " (interpolated: freq " << fft_peaks_f(fft)[i]
+         << " value " << fft_peaks_a(fft)[i] << ")"
          << endl;
   }
 
   fft_free(fft);
 
-  return 0;
+  bool ok = check_peaksearch_equivalence();
+  cout << "Peak search equivalence: " << (ok ? "OK" : "FAILED") << endl;
+  bool ok_interp = check_peak_interpolation();
+  cout << "Peak interpolation: " << (ok_interp ? "OK" : "FAILED") << endl;
+  ok = ok && ok_interp;
+  bool ok_track = check_peak_tracking();
+  cout << "Peak tracking: " << (ok_track ? "OK" : "FAILED") << endl;
+  ok = ok && ok_track;
+  bool ok_goertzel = check_goertzel();
+  cout << "Goertzel bank: " << (ok_goertzel ? "OK" : "FAILED") << endl;
+  ok = ok && ok_goertzel;
+  bool ok_zoom = check_zoom_fft();
+  cout << "Zoom FFT: " << (ok_zoom ? "OK" : "FAILED") << endl;
+  ok = ok && ok_zoom;
+
+  return ok ? 0 : 1;
 }
\ No newline at end of file
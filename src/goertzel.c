@@ -0,0 +1,203 @@
+/******************************************************************************\
+ _____ _____ _____         _   _ _ _ _   _
+|  ___|  ___|_   _|  _   _| |_(_) (_) |_(_) ___  ___
+| |_  | |_    | |   | | | | __| | | | __| |/ _ \/ __|
+|  _| |  _|   | |   | |_| | |_| | | | |_| |  __/\__ \
+|_|   |_|     |_|    \__,_|\__|_|_|_|\__|_|\___||___/
+
+==============================================================================
+ File:         goertzel.c
+ LICENSE:      MIT
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the "Software"), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+\******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "goertzel.h"
+
+typedef struct goertzel {
+  index_t k;        // number of targets
+  index_t n;        // window length
+  data_t  fs;       // sampling frequency
+  int     sliding;  // sliding (1) or block (0) mode
+  data_t *freqs;    // target frequencies
+  data_t *cw, *sw;  // cos(w), sin(w) for each target
+  data_t *cn, *sn;  // cos(w(n-1)), sin(w(n-1)) for each target
+  data_t *s1, *s2;  // Goertzel state (block mode)
+  data_t *re, *im;  // last result: sum_m x[m] exp(-j w m)
+  data_t *ring;     // last n samples (sliding mode only)
+  index_t head;     // next position in ring (oldest sample when full)
+  size_t  count;    // samples in current block/window
+  index_t since;    // sliding updates since last exact recomputation
+} goertzel_t;
+
+static data_t *goertzel_alloc(size_t n) {
+  data_t *p = (data_t *)calloc(n, sizeof(data_t));
+  if (p == NULL) {
+    perror("goertzel malloc error");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+goertzel_t *goertzel_init(const data_t *freqs, index_t k, data_t fs,
+                          index_t n, int sliding) {
+  index_t i;
+  goertzel_t *g = (goertzel_t *)malloc(sizeof(goertzel_t));
+  if (g == NULL) {
+    perror("goertzel malloc error");
+    exit(EXIT_FAILURE);
+  }
+  assert(n > 1 && k > 0);
+  memset(g, 0, sizeof(goertzel_t));
+  g->k = k;
+  g->n = n;
+  g->fs = fs;
+  g->sliding = sliding;
+  g->freqs = goertzel_alloc(k);
+  g->cw = goertzel_alloc(k);
+  g->sw = goertzel_alloc(k);
+  g->cn = goertzel_alloc(k);
+  g->sn = goertzel_alloc(k);
+  g->s1 = goertzel_alloc(k);
+  g->s2 = goertzel_alloc(k);
+  g->re = goertzel_alloc(k);
+  g->im = goertzel_alloc(k);
+  if (sliding) g->ring = goertzel_alloc(n);
+  for (i = 0; i < k; i++) {
+    const data_t w = 2 * M_PI * freqs[i] / fs;
+    g->freqs[i] = freqs[i];
+    g->cw[i] = cos(w);
+    g->sw[i] = sin(w);
+    g->cn[i] = cos(w * (n - 1));
+    g->sn[i] = sin(w * (n - 1));
+  }
+  goertzel_reset(g);
+  return g;
+}
+
+void goertzel_free(goertzel_t *g) {
+  assert(g != NULL);
+  free(g->freqs);
+  free(g->cw);
+  free(g->sw);
+  free(g->cn);
+  free(g->sn);
+  free(g->s1);
+  free(g->s2);
+  free(g->re);
+  free(g->im);
+  free(g->ring);
+  free(g);
+}
+
+void goertzel_reset(goertzel_t *g) {
+  memset(g->s1, 0, g->k * sizeof(data_t));
+  memset(g->s2, 0, g->k * sizeof(data_t));
+  memset(g->re, 0, g->k * sizeof(data_t));
+  memset(g->im, 0, g->k * sizeof(data_t));
+  if (g->ring) memset(g->ring, 0, g->n * sizeof(data_t));
+  g->head = 0;
+  g->count = 0;
+  g->since = 0;
+}
+
+// Turn the final Goertzel state into sum_m x[m] exp(-j w m):
+// s1 - exp(-jw) s2 = exp(jw(n-1)) X
+static void goertzel_result(goertzel_t *const g, index_t i) {
+  const data_t yr = g->s1[i] - g->cw[i] * g->s2[i];
+  const data_t yi = g->sw[i] * g->s2[i];
+  g->re[i] = yr * g->cn[i] + yi * g->sn[i];
+  g->im[i] = yi * g->cn[i] - yr * g->sn[i];
+}
+
+// Exact result over the ring content (oldest first), by Goertzel recursion;
+// bounds the drift of the sliding updates
+static void goertzel_anchor(goertzel_t *const g) {
+  index_t i, m;
+  for (i = 0; i < g->k; i++) {
+    const data_t c = 2 * g->cw[i];
+    data_t s0, s1 = 0, s2 = 0;
+    for (m = 0; m < g->n; m++) {
+      s0 = g->ring[(g->head + m) % g->n] + c * s1 - s2;
+      s2 = s1;
+      s1 = s0;
+    }
+    g->s1[i] = s1;
+    g->s2[i] = s2;
+    goertzel_result(g, i);
+  }
+  g->since = 0;
+}
+
+int goertzel_add_point(goertzel_t *const g, data_t x) {
+  index_t i;
+  if (!g->sliding) {
+    for (i = 0; i < g->k; i++) {
+      const data_t s0 = x + 2 * g->cw[i] * g->s1[i] - g->s2[i];
+      g->s2[i] = g->s1[i];
+      g->s1[i] = s0;
+    }
+    if (++g->count < g->n) return 0;
+    for (i = 0; i < g->k; i++) {
+      goertzel_result(g, i);
+      g->s1[i] = g->s2[i] = 0;
+    }
+    g->count = 0;
+    return 1;
+  }
+
+  const data_t old = g->ring[g->head];
+  g->ring[g->head] = x;
+  g->head = (g->head + 1) % g->n;
+  if (g->count < g->n) {
+    if (++g->count < g->n) return 0;
+    goertzel_anchor(g);
+    return 1;
+  }
+  if (++g->since >= g->n) {
+    goertzel_anchor(g);
+    return 1;
+  }
+  // X' = exp(jw) (X - x_old) + x_new exp(-jw(n-1))
+  for (i = 0; i < g->k; i++) {
+    const data_t r = g->re[i] - old;
+    const data_t im = g->im[i];
+    g->re[i] = g->cw[i] * r - g->sw[i] * im + x * g->cn[i];
+    g->im[i] = g->sw[i] * r + g->cw[i] * im - x * g->sn[i];
+  }
+  return 1;
+}
+
+
+index_t goertzel_k(const goertzel_t *g) { return g->k; }
+index_t goertzel_n(const goertzel_t *g) { return g->n; }
+data_t *goertzel_freqs(const goertzel_t *g) { return g->freqs; }
+data_t goertzel_amplitude(const goertzel_t *g, index_t i) {
+  return 2 * sqrt(g->re[i] * g->re[i] + g->im[i] * g->im[i]) / g->n;
+}
+data_t goertzel_phase(const goertzel_t *g, index_t i) {
+  return atan2(g->im[i], g->re[i]);
+}
@@ -0,0 +1,79 @@
+/******************************************************************************\
+ _____ _____ _____         _   _ _ _ _   _
+|  ___|  ___|_   _|  _   _| |_(_) (_) |_(_) ___  ___
+| |_  | |_    | |   | | | | __| | | | __| |/ _ \/ __|
+|  _| |  _|   | |   | |_| | |_| | | | |_| |  __/\__ \
+|_|   |_|     |_|    \__,_|\__|_|_|_|\__|_|\___||___/
+
+==============================================================================
+ File:         goertzel.h
+ LICENSE:      MIT
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the "Software"), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+\******************************************************************************/
+
+#ifndef GOERTZEL_H
+#define GOERTZEL_H
+
+#include "fft.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// Filter bank evaluating the DFT of the last n samples at a few given
+// frequencies, without computing a whole spectrum:
+// - block mode: classic Goertzel recursion, results every n samples, two
+//   state values per target
+// - sliding mode: results updated at each new sample (once n samples have
+//   been received), keeps the last n samples in a ring buffer
+// Costs O(k) per sample in both modes, with k the number of targets, and n
+// is not restricted to powers of 2.
+
+// Object Structure
+typedef struct goertzel goertzel_t;
+
+// Initializer&de-initializer
+// freqs: k target frequencies; fs: sampling frequency; n: window length
+goertzel_t *goertzel_init(const data_t *freqs, index_t k, data_t fs,
+                          index_t n, int sliding);
+void goertzel_free(goertzel_t *g);
+void goertzel_reset(goertzel_t *g);
+
+// Append a sample
+// returns 1 when new results are available, 0 otherwise
+int goertzel_add_point(goertzel_t *const g, data_t x);
+
+// Accessors
+index_t goertzel_k(const goertzel_t *g);
+index_t goertzel_n(const goertzel_t *g);
+data_t *goertzel_freqs(const goertzel_t *g);
+// Amplitude of a sinusoid at target i (2|X|/n)
+data_t goertzel_amplitude(const goertzel_t *g, index_t i);
+// Phase of target i, referred to the first sample of the window
+data_t goertzel_phase(const goertzel_t *g, index_t i);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
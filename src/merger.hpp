@@ -0,0 +1,136 @@
+/*
+  _____              _
+ |  ___|_ _ _ __    (_)_ __
+ | |_ / _` | '_ \   | | '_ \
+ |  _| (_| | | | |  | | | | |
+ |_|  \__,_|_| |_|  |_|_| |_|
+
+Fan-in of several acquisition devices into one stream of combined samples,
+with the channels of all the devices side by side. Devices are aligned on
+the timestamps of the first one (reference), taking from each of the other
+devices the sample nearest in time, or, with merge_rate, all the devices are
+resampled by linear interpolation onto a common grid. Samples are merged as
+soon as every device has data up to their time, or when they are older than
+merge_max_lag_ms with respect to the newest reference sample, so that a
+stalled device only delays the output by that much; missing values are NaN
+(null in JSON).
+Configured by the plugin settings:
+  merge_rate         = 0.0    # Hz, common grid (0: reference timestamps)
+  merge_tolerance_ms = 0.0    # max distance of the nearest sample (0: any)
+  merge_max_lag_ms   = 1000.0 # max wait for the slower devices
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Sample is an Acquisitor<T>::sample
+template <typename Sample>
+class FanInMerger {
+public:
+  using json = nlohmann::json;
+  using time_point = decltype(Sample::time);
+
+  // a combined sample, with the same interface as Acquisitor<T>::sample
+  struct sample {
+    time_point time;
+    std::vector<double> data;
+
+    double time_since(time_point t0) const {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(time - t0).count() / 1.0E9;
+    }
+  };
+
+  FanInMerger(json const &settings, size_t devices) : _buf(devices) {
+    double rate = settings.value("merge_rate", 0.0);
+    if (rate > 0) _period = std::chrono::nanoseconds((int64_t)std::llround(1e9 / rate));
+    _tolerance = std::chrono::duration<double, std::milli>(settings.value("merge_tolerance_ms", 0.0));
+    _max_lag = std::chrono::duration<double, std::milli>(settings.value("merge_max_lag_ms", 1000.0));
+  }
+
+  size_t devices() const { return _buf.size(); }
+  size_t channels() const { return _buf.size() * WIDTH; }
+  // samples waiting for the other devices
+  size_t pending(size_t device) const { return _buf[device].size(); }
+
+  void add(size_t device, std::vector<Sample> const &batch) {
+    _buf[device].insert(_buf[device].end(), batch.begin(), batch.end());
+  }
+
+  // Combined samples that can be completed with the data added so far
+  std::vector<sample> merge() {
+    std::vector<sample> out;
+    auto &ref = _buf[0];
+    if (ref.empty()) return out;
+    time_point until = ref.back().time;
+    for (auto const &b : _buf)
+      until = b.empty() ? time_point::min() : std::min(until, b.back().time);
+    until = std::max(until, ref.back().time - std::chrono::duration_cast<std::chrono::nanoseconds>(_max_lag));
+
+    while (true) {
+      time_point t;
+      if (_period.count() > 0) {
+        if (!_started) _next = ref.front().time;
+        t = _next;
+        if (t > ref.back().time) break;
+      } else {
+        auto it = std::find_if(ref.begin(), ref.end(), [this](Sample const &s) {
+          return !_started || s.time > _last;
+        });
+        if (it == ref.end()) break;
+        t = it->time;
+      }
+      if (t > until) break;
+      sample m{t, {}};
+      m.data.reserve(channels());
+      for (size_t d = 0; d < _buf.size(); d++) value_at(d, t, m.data);
+      out.push_back(std::move(m));
+      _started = true;
+      _last = t;
+      _next = t + _period;
+    }
+    return out;
+  }
+
+private:
+  static constexpr size_t WIDTH = std::tuple_size_v<decltype(Sample::data)>;
+  std::vector<std::deque<Sample>> _buf;
+  std::chrono::nanoseconds _period{0};
+  std::chrono::duration<double, std::milli> _tolerance, _max_lag;
+  bool _started = false;
+  time_point _last{}, _next{};
+
+  // Append the values of device d at time t (non-decreasing between calls),
+  // dropping the samples no longer needed
+  void value_at(size_t d, time_point t, std::vector<double> &out) {
+    auto &b = _buf[d];
+    while (b.size() > 1 && b[1].time <= t) b.pop_front();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    if (b.empty()) {
+      out.insert(out.end(), WIDTH, nan);
+      return;
+    }
+    if (_period.count() > 0 && b.size() > 1 && b[0].time <= t) { // interpolate
+      const double w = std::chrono::duration<double>(t - b[0].time).count() /
+                       std::chrono::duration<double>(b[1].time - b[0].time).count();
+      for (size_t c = 0; c < WIDTH; c++)
+        out.push_back(b[0].data[c] + w * (b[1].data[c] - b[0].data[c]));
+      return;
+    }
+    // nearest of the samples around t
+    Sample const *s = &b[0];
+    if (b.size() > 1 && b[1].time - t < (t > b[0].time ? t - b[0].time : b[0].time - t))
+      s = &b[1];
+    auto dist = s->time > t ? s->time - t : t - s->time;
+    if (_tolerance.count() > 0 && dist > _tolerance) {
+      out.insert(out.end(), WIDTH, nan);
+      return;
+    }
+    for (size_t c = 0; c < WIDTH; c++) out.push_back(s->data[c]);
+  }
+};
@@ -1,87 +1,393 @@
 #define _USE_MATH_DEFINES // for C++
 #include <cmath>
+#include <algorithm>
+#include <array>
 #include <complex>
 #include <iostream>
 #include <iomanip>
 #include "moving_window_stats.hpp"
 
-bool MovingWindowStats::add(std::string const key, double value) {
-    auto &buffer = _signal_buffers[key];
-    auto &sum = _sum[key];
-    auto &sum_sq = _sum_sq[key];
+// Power sums (d, d^2, d^3, d^4) of a block, with d = x - shift, using
+// independent partial sums so that the compiler can vectorize the loop (no
+// reassociation needed)
+static void block_sums(const double *x, size_t n, double shift, double sums[4]) {
+    constexpr size_t L = 4;
+    double s[4][L] = {{0}};
+    size_t i = 0;
+    for (; i + L <= n; i += L) {
+        for (size_t l = 0; l < L; l++) {
+            double d = x[i + l] - shift, d2 = d * d;
+            s[0][l] += d;
+            s[1][l] += d2;
+            s[2][l] += d2 * d;
+            s[3][l] += d2 * d2;
+        }
+    }
+    for (; i < n; i++) {
+        double d = x[i] - shift, d2 = d * d;
+        s[0][0] += d;
+        s[1][0] += d2;
+        s[2][0] += d2 * d;
+        s[3][0] += d2 * d2;
+    }
+    for (size_t p = 0; p < 4; p++)
+        sums[p] = (s[p][0] + s[p][1]) + (s[p][2] + s[p][3]);
+}
+
+// Neumaier compensated accumulation: acc + c holds the sum more accurately
+// than acc alone
+static void compensated_add(double &acc, double &c, double x) {
+    double t = acc + x;
+    if (std::abs(acc) >= std::abs(x))
+        c += (acc - t) + x;
+    else
+        c += (x - t) + acc;
+    acc = t;
+}
 
-    // push new value
-    buffer.push_back(value);
-    sum += value;
-    sum_sq += value * value;
+// Add (sign = 1) or remove (sign = -1) a value from the power sums
+static void power_sums_add(double sum[4], double sum_c[4], double x, double sign) {
+    double x2 = x * x;
+    compensated_add(sum[0], sum_c[0], sign * x);
+    compensated_add(sum[1], sum_c[1], sign * x2);
+    compensated_add(sum[2], sum_c[2], sign * x2 * x);
+    compensated_add(sum[3], sum_c[3], sign * x2 * x2);
+}
 
-    if (buffer.size() > _size) {
-        double old = buffer.front();
-        buffer.pop_front();
-        sum -= old;
-        sum_sq -= old * old;
+// Exact power sums of the window, centred on its mean (two passes over the
+// ring). Run every _size samples, so that rounding errors cannot accumulate
+// and the shift follows slow drifts of the mean: amortized O(1) per sample
+void MovingWindowStats::recompute_sums(Channel &ch) {
+    size_t first = std::min(ch.count, _size - ch.head);
+    double s1[4], s2[4];
+    block_sums(ch.ring.data() + ch.head, first, 0.0, s1);
+    block_sums(ch.ring.data(), ch.count - first, 0.0, s2);
+    ch.shift = (s1[0] + s2[0]) / ch.count;
+    block_sums(ch.ring.data() + ch.head, first, ch.shift, s1);
+    block_sums(ch.ring.data(), ch.count - first, ch.shift, s2);
+    for (size_t p = 0; p < 4; p++) {
+        ch.sum[p] = s1[p] + s2[p];
+        ch.sum_c[p] = 0;
     }
+    ch.since_exact = 0;
+}
 
-    size_t n = buffer.size();
+// Sample idx enters the window, sample idx - _size (value old) leaves it if
+// evict is true
+void MovingWindowStats::update_order(Channel &ch, size_t idx, double value,
+                                     bool evict, double old) {
+    size_t first = idx + 1 > _size ? idx + 1 - _size : 0;
+    ch.min_q.expire(first);
+    ch.max_q.expire(first);
+    ch.min_q.push(idx, value);
+    ch.max_q.push(idx, value);
+    if (_quantiles) {
+        if (evict) ch.quant.erase(old, idx - _size);
+        ch.quant.insert(value, idx);
+    }
+}
+
+bool MovingWindowStats::add(handle h, double value) {
+    auto &ch = _channels[h];
+    if (_size == 0) return false;
+
+    // push new value, overwriting the oldest one if the ring is full
+    bool slid = false;
+    double old = 0.0;
+    if (ch.count < _size) {
+        size_t tail = ch.head + ch.count;
+        ch.ring[tail < _size ? tail : tail - _size] = value;
+        ch.count++;
+    } else {
+        old = ch.ring[ch.head];
+        ch.ring[ch.head] = value;
+        if (++ch.head == _size) ch.head = 0;
+        power_sums_add(ch.sum, ch.sum_c, old - ch.shift, -1);
+        slid = true;
+    }
+    if (ch.samples == 0) ch.shift = value;
+    power_sums_add(ch.sum, ch.sum_c, value - ch.shift, 1);
+    update_order(ch, ch.samples, value, slid, old);
+    ch.samples++;
+    if (++ch.since_exact >= _size) recompute_sums(ch);
+
+    size_t n = ch.count;
 
     // recurrent mean & stdev
-    double mean = sum / n;
-    _mean[key] = mean;
+    update_stats(ch);
 
-    double variance = (sum_sq / n) - mean * mean;
+    // compute acf and fft only if buffer is full, and every _hop samples
+    if (n < _size) return false;
+    if (_hop == on_demand || ch.samples - ch.acf_at < _hop) return true;
+    calculate_acf(ch);
+    // at each sample, the spectrum is slid in O(N) from the previous one; the
+    // exact recomputation only runs once every N samples to bound the
+    // accumulated rounding error
+    if (_hop == 1 && slid && ch.fft_at == ch.samples - 1 && ch.dft_slides < _size)
+        slide_fft(ch, value, old);
+    else
+        calculate_fft(ch);
+    return true;
+}
+
+// Moments from the power sums of x - shift. Since the shift is close to the
+// mean, d is small and the central moments suffer no cancellation, even with
+// a large DC offset
+void MovingWindowStats::update_stats(Channel &ch) {
+    size_t n = ch.count;
+    double m[4]; // moments about the shift
+    for (size_t p = 0; p < 4; p++) m[p] = (ch.sum[p] + ch.sum_c[p]) / n;
+    double d = m[0], d2 = d * d;
+    ch.mean = ch.shift + d;
+    double variance = m[1] - d2;
     if (variance < 0) variance = 0; // numerical guard
-    _stdev[key] = std::sqrt(variance);
+    ch.stdev = std::sqrt(variance);
+    ch.rms = std::sqrt(ch.mean * ch.mean + variance);
+    // central moments from the shifted ones
+    double m3 = m[2] - 3 * d * m[1] + 2 * d * d2;
+    double m4 = m[3] - 4 * d * m[2] + 6 * d2 * m[1] - 3 * d2 * d2;
+    ch.skewness = variance > 0 ? m3 / (variance * ch.stdev) : 0.0;
+    ch.kurtosis = variance > 0 ? m4 / (variance * variance) : 0.0;
+}
+
+bool MovingWindowStats::add(handle h, std::span<const double> values) {
+    auto &ch = _channels[h];
+    size_t m = values.size();
+    if (_size == 0 || m == 0) return is_full(h);
 
-    // compute acf and fft only if buffer is full
-    if (buffer.size() == _size) {
-        calculate_acf(key);
-        calculate_fft(key);
-        return true;
+    if (m >= _size) {
+        // only the last _size values survive: start over from them
+        size_t samples = ch.samples + m;
+        ch.clear(_size, _quantiles);
+        std::copy(values.end() - _size, values.end(), ch.ring.begin());
+        ch.count = _size;
+        recompute_sums(ch);
+        for (size_t i = 0; i < _size; i++)
+            update_order(ch, samples - _size + i, ch.ring[i], false, 0.0);
+        ch.samples = samples;
     } else {
-        return false;
+        if (ch.samples == 0) ch.shift = values[0];
+        double in[4], out[4] = {0};
+        block_sums(values.data(), m, ch.shift, in);
+        // the oldest values are overwritten: they are contiguous in the ring
+        // except for a possible wrap-around
+        size_t n_out = ch.count + m > _size ? ch.count + m - _size : 0;
+        for (size_t done = 0; done < n_out;) {
+            size_t from = (ch.head + done) % _size;
+            size_t len = std::min(n_out - done, _size - from);
+            double s[4];
+            block_sums(ch.ring.data() + from, len, ch.shift, s);
+            for (size_t p = 0; p < 4; p++) out[p] += s[p];
+            done += len;
+        }
+        // order statistics need each value: the j-th new value evicts the
+        // (count + j - _size)-th oldest one, still in the ring at this point
+        for (size_t j = 0; j < m; j++) {
+            bool evict = ch.count + j >= _size;
+            double old = evict ? ch.window(ch.count + j - _size) : 0.0;
+            update_order(ch, ch.samples + j, values[j], evict, old);
+        }
+        // copy the new values after the newest one, in up to two segments
+        size_t tail = (ch.head + ch.count) % _size;
+        size_t len = std::min(m, _size - tail);
+        std::copy(values.begin(), values.begin() + len, ch.ring.begin() + tail);
+        std::copy(values.begin() + len, values.end(), ch.ring.begin());
+        ch.head = (ch.head + n_out) % _size;
+        ch.count = std::min(ch.count + m, _size);
+        for (size_t p = 0; p < 4; p++)
+            compensated_add(ch.sum[p], ch.sum_c[p], in[p] - out[p]);
+        ch.samples += m;
+        ch.since_exact += m;
+        if (ch.since_exact >= _size) recompute_sums(ch);
+    }
+    update_stats(ch);
+
+    if (ch.count < _size) return false;
+    if (_hop == on_demand || ch.samples - ch.acf_at < _hop) return true;
+    calculate_acf(ch);
+    calculate_fft(ch);
+    return true;
+}
+
+double MovingWindowStats::percentile(handle h, double p) {
+    auto &ch = _channels[h];
+    size_t n = ch.count;
+    if (n == 0) return 0.0;
+    p = std::clamp(p, 0.0, 100.0);
+    double pos = p / 100.0 * (n - 1);
+    size_t lo = (size_t)std::floor(pos), hi = std::min(lo + 1, n - 1);
+    double v_lo, v_hi;
+    if (_quantiles) {
+        v_lo = ch.quant.kth(lo);
+        v_hi = ch.quant.kth(hi);
+    } else {
+        // no order-statistic tree: select on a copy of the window, O(N)
+        _work_re.resize(n);
+        for (size_t i = 0; i < n; i++) _work_re[i] = ch.window(i);
+        std::nth_element(_work_re.begin(), _work_re.begin() + lo, _work_re.end());
+        v_lo = _work_re[lo];
+        v_hi = hi > lo ? *std::min_element(_work_re.begin() + hi, _work_re.end()) : v_lo;
+    }
+    // linear interpolation between closest ranks
+    return v_lo + (v_hi - v_lo) * (pos - lo);
+}
+
+// Wiener-Khinchin: the ACF is the inverse transform of the power spectrum of
+// the (mean-removed) window, zero-padded to at least 2N to avoid wrap-around.
+// The power spectrum is real and even, so a forward transform does as well as
+// the inverse one.
+void MovingWindowStats::calculate_acf(Channel &ch) {
+    size_t N = ch.count;
+    ch.acf_at = ch.samples;
+    if (N < ACF_FFT_MIN_SIZE) {
+        calculate_acf_direct(ch);
+        return;
+    }
+
+    prepare_plan(N);
+    size_t M = fft_plan_n(_plan.get());
+    _work_re.assign(M, 0.0);
+    _work_im.assign(M, 0.0);
+
+    for (size_t i = 0; i < N; i++) {
+        _work_re[i] = ch.window(i) - ch.mean;
+    }
+    fft_plan_exec(_plan.get(), _work_re.data(), _work_im.data());
+    for (size_t i = 0; i < M; i++) {
+        _work_re[i] = _work_re[i] * _work_re[i] + _work_im[i] * _work_im[i];
+        _work_im[i] = 0.0;
+    }
+    fft_plan_exec(_plan.get(), _work_re.data(), _work_im.data());
+
+    // lag 0 is the sum of squared deviations, i.e. the normalization factor
+    ch.acf.resize(N);
+    double denom = _work_re[0];
+    for (size_t lag = 0; lag < N; lag++) {
+        ch.acf[lag] = denom > 0 ? _work_re[lag] / denom : 0.0;
     }
 }
 
-void MovingWindowStats::calculate_acf(std::string const &key) {
-    const auto &buffer = _signal_buffers[key];
-    size_t N = buffer.size();
+void MovingWindowStats::calculate_acf_direct(Channel &ch) {
+    size_t N = ch.count;
     std::vector<double> acf(N, 0.0);
 
-    double mean = _mean[key];
+    double mean = ch.mean;
     double denom = 0.0;
     for (size_t i = 0; i < N; i++) {
-        denom += (buffer[i] - mean) * (buffer[i] - mean);
+        denom += (ch.window(i) - mean) * (ch.window(i) - mean);
     }
 
     for (size_t lag = 0; lag < N; lag++) {
         double num = 0.0;
         for (size_t i = 0; i < N - lag; i++) {
-            num += (buffer[i] - mean) * (buffer[i + lag] - mean);
+            num += (ch.window(i) - mean) * (ch.window(i + lag) - mean);
         }
         acf[lag] = denom > 0 ? num / denom : 0.0;
     }
 
-    _signal_acf[key] = std::move(acf);
+    ch.acf = std::move(acf);
 }
 
-void MovingWindowStats::calculate_fft(std::string const &key) {
-    const auto &buffer = _signal_buffers[key];
-    size_t N = buffer.size();
-    std::vector<double> fft_magnitude(N, 0.0);
+// Plan of size M >= 2N (power of 2) and transform of the chirp-z filter
+// b[n] = e^(j pi n^2/N), stored circularly for n in (-N, N)
+void MovingWindowStats::prepare_plan(size_t N) {
+    if (_plan && _chirp.size() == N) return;
+    index_t power = 1;
+    while (((size_t)1 << power) < 2 * N) power++;
+    _plan.reset(fft_plan_init(power));
+    size_t M = fft_plan_n(_plan.get());
 
-    // naive DFT implementation
-    for (size_t k = 0; k < N; k++) {
+    _chirp.resize(N);
+    _chirp_re.assign(M, 0.0);
+    _chirp_im.assign(M, 0.0);
+    for (size_t n = 0; n < N; n++) {
+        // n^2 mod 2N keeps the angle small (and accurate) for large n
+        _chirp[n] = std::polar(1.0, -M_PI * double((n * n) % (2 * N)) / N);
+        _chirp_re[n] = _chirp[n].real();
+        _chirp_im[n] = -_chirp[n].imag();
+        if (n > 0) {
+            _chirp_re[M - n] = _chirp_re[n];
+            _chirp_im[M - n] = _chirp_im[n];
+        }
+    }
+    fft_plan_exec(_plan.get(), _chirp_re.data(), _chirp_im.data());
+}
+
+// Exact DFT of the current window (first N/2 bins). Chirp-z (Bluestein):
+// with w[n] = e^(-j pi n^2/N), X[k] = w[k] sum_n (x[n] w[n]) conj(w[k-n]),
+// a convolution computed with the power-of-2 plan in O(N log N), for any N
+void MovingWindowStats::calculate_fft(Channel &ch) {
+    size_t N = ch.count;
+    if (_twiddles.size() != N) {
+        _twiddles.resize(N);
+        for (size_t k = 0; k < N; k++)
+            _twiddles[k] = std::polar(1.0, 2.0 * M_PI * k / N);
+    }
+    ch.fft_at = ch.samples;
+    ch.dft_slides = 0;
+    if (N < ACF_FFT_MIN_SIZE) {
+        calculate_fft_direct(ch);
+        return;
+    }
+
+    prepare_plan(N);
+    size_t M = fft_plan_n(_plan.get());
+    _work_re.assign(M, 0.0);
+    _work_im.assign(M, 0.0);
+    for (size_t n = 0; n < N; n++) {
+        _work_re[n] = ch.window(n) * _chirp[n].real();
+        _work_im[n] = ch.window(n) * _chirp[n].imag();
+    }
+    fft_plan_exec(_plan.get(), _work_re.data(), _work_im.data());
+    // product with the filter, conjugated so that the forward plan acts as
+    // the inverse transform: ifft(z) = conj(fft(conj(z))) / M
+    for (size_t i = 0; i < M; i++) {
+        double re = _work_re[i] * _chirp_re[i] - _work_im[i] * _chirp_im[i];
+        double im = _work_re[i] * _chirp_im[i] + _work_im[i] * _chirp_re[i];
+        _work_re[i] = re;
+        _work_im[i] = -im;
+    }
+    fft_plan_exec(_plan.get(), _work_re.data(), _work_im.data());
+
+    ch.dft.resize(N / 2);
+    ch.fft.resize(N / 2);
+    for (size_t k = 0; k < N / 2; k++) {
+        std::complex<double> c(_work_re[k] / M, -_work_im[k] / M);
+        ch.dft[k] = _chirp[k] * c;
+        // Store only the first N/2 magnitudes (for real signals, FFT is symmetric)
+        ch.fft[k] = std::abs(ch.dft[k]) / N;
+    }
+}
+
+// Exact DFT of the current window (first N/2 bins), with tabulated twiddles
+void MovingWindowStats::calculate_fft_direct(Channel &ch) {
+    size_t N = ch.count;
+    ch.dft.assign(N / 2, std::complex<double>(0.0, 0.0));
+    for (size_t k = 0; k < N / 2; k++) {
         std::complex<double> sum(0.0, 0.0);
-        for (size_t n = 0; n < N; n++) {
-            double angle = -2.0 * M_PI * k * n / N;
-            sum += buffer[n] * std::exp(std::complex<double>(0.0, angle));
+        for (size_t n = 0, kn = 0; n < N; n++, kn = (kn + k) % N) {
+            sum += ch.window(n) * std::conj(_twiddles[kn]);
         }
-        fft_magnitude[k] = std::abs(sum) / N;
+        ch.dft[k] = sum;
     }
 
     // Store only the first N/2 magnitudes (for real signals, FFT is symmetric)
-    std::vector<double> fft_half(fft_magnitude.begin(), fft_magnitude.begin() + N / 2);
-    _signal_fft[key] = std::move(fft_half);
+    ch.fft.resize(N / 2);
+    for (size_t k = 0; k < N / 2; k++)
+        ch.fft[k] = std::abs(ch.dft[k]) / N;
+}
+
+// Sliding DFT: when the window moves by one sample (`in` enters, `out`
+// leaves), each bin updates as X_k <- (X_k - out + in) e^(j2pi k/N)
+void MovingWindowStats::slide_fft(Channel &ch, double in, double out) {
+    size_t N = _twiddles.size();
+    double delta = in - out;
+    for (size_t k = 0; k < ch.dft.size(); k++) {
+        ch.dft[k] = (ch.dft[k] + delta) * _twiddles[k];
+        ch.fft[k] = std::abs(ch.dft[k]) / N;
+    }
+    ch.dft_slides++;
+    ch.fft_at = ch.samples;
 }
 
 #ifdef MOVING_WINDOW_STATS_TEST
@@ -90,8 +396,11 @@ int main() {
     stats.reset(1000);
 
     std::string key = "signal";
+    MovingWindowStats::handle h = stats.channel(key);
+    std::vector<double> signal;
     for (int i = 0; i < 1000; i++) {
         double val = std::sin(2 * M_PI * 3 * i / 1000.0) + 0.1 * ((rand() % 100) / 100.0 - 0.5);
+        signal.push_back(val);
         stats.add(key, val);
     }
 
@@ -102,6 +411,139 @@ int main() {
     for (auto v : stats.acf(key)) std::cout << v << " ";
     std::cout << "\n";
 
+    // compare the FFT-based ACF with its definition
+    double mean = stats.mean(key), denom = 0.0, max_diff = 0.0;
+    for (auto v : signal) denom += (v - mean) * (v - mean);
+    for (size_t lag = 0; lag < signal.size(); lag++) {
+        double num = 0.0;
+        for (size_t i = 0; i < signal.size() - lag; i++)
+            num += (signal[i] - mean) * (signal[i + lag] - mean);
+        max_diff = std::max(max_diff, std::abs(num / denom - stats.acf(key)[lag]));
+    }
+    std::cout << "ACF max deviation from direct method: " << max_diff << "\n";
+
+    // keep sliding and compare the spectrum with a naive DFT of the window
+    for (int i = 1000; i < 2500; i++) {
+        double val = std::sin(2 * M_PI * 3 * i / 1000.0) + 0.1 * ((rand() % 100) / 100.0 - 0.5);
+        signal.push_back(val);
+        stats.add(h, val);
+    }
+    double max_dft_diff = 0.0;
+    size_t N = 1000, start = signal.size() - N;
+    for (size_t k = 0; k < N / 2; k++) {
+        std::complex<double> sum(0.0, 0.0);
+        for (size_t n = 0; n < N; n++)
+            sum += signal[start + n] * std::exp(std::complex<double>(0.0, -2.0 * M_PI * k * n / N));
+        max_dft_diff = std::max(max_dft_diff, std::abs(std::abs(sum) / N - stats.fft(h)[k]));
+    }
+    std::cout << "Sliding DFT max deviation from naive DFT: " << max_dft_diff << "\n";
+
+    // on demand and every 100 samples: same results when read at a hop
+    // boundary, computed only once
+    MovingWindowStats lazy(1000, MovingWindowStats::on_demand), hopping(1000, 100);
+    for (size_t i = 0; i < signal.size(); i++) {
+        lazy.add(key, signal[i]);
+        hopping.add(key, signal[i]);
+    }
+    double max_lazy_diff = 0.0;
+    for (size_t k = 0; k < N / 2; k++) {
+        max_lazy_diff = std::max(max_lazy_diff, std::abs(lazy.fft(key)[k] - stats.fft(h)[k]));
+        max_lazy_diff = std::max(max_lazy_diff, std::abs(hopping.fft(key)[k] - stats.fft(h)[k]));
+        max_lazy_diff = std::max(max_lazy_diff, std::abs(lazy.acf(key)[k] - stats.acf(h)[k]));
+    }
+    std::cout << "On-demand/hop max deviation from per-sample: " << max_lazy_diff
+              << " (spectrum at sample " << lazy.fft_index(lazy.channel(key)) << ")\n";
+
+    // whole batches of two-channel samples, as from Acquisitor<T>::data()
+    struct sample { double time; std::array<double, 2> data; };
+    MovingWindowStats batched(1000);
+    std::vector<MovingWindowStats::handle> channels = {
+        batched.channel("a"), batched.channel("b")};
+    std::vector<sample> batch;
+    for (size_t i = 0; i < signal.size(); i++) {
+        batch.push_back({i / 1000.0, {signal[i], -2 * signal[i]}});
+        if (batch.size() == 64 || i == signal.size() - 1) {
+            batched.add_batch(batch, channels);
+            batch.clear();
+        }
+    }
+    double max_batch_diff = std::abs(batched.mean("a") - stats.mean(h)) +
+                            std::abs(batched.stdev("a") - stats.stdev(h)) +
+                            std::abs(batched.stdev("b") - 2 * stats.stdev(h));
+    for (size_t k = 0; k < N / 2; k++) {
+        max_batch_diff = std::max(max_batch_diff, std::abs(batched.fft("a")[k] - stats.fft(h)[k]));
+        max_batch_diff = std::max(max_batch_diff, std::abs(batched.acf("b")[k] - stats.acf(h)[k]));
+    }
+    std::cout << "Batch max deviation from per-sample: " << max_batch_diff << "\n";
+
+    // windowed features, incremental vs computed from the window
+    MovingWindowStats features(500);
+    features.set_quantiles(true);
+    auto hf = features.channel(key);
+    for (size_t i = 0; i < 1700; i++) features.add(hf, signal[i]);
+    features.add(hf, std::span<const double>(signal).subspan(1700, 300));
+    std::vector<double> w(signal.end() - 500 - 500, signal.end() - 500);
+    std::sort(w.begin(), w.end());
+    double mu = 0, m2 = 0, m3 = 0, m4 = 0, ms = 0;
+    for (auto v : w) mu += v / w.size();
+    for (auto v : w) {
+        double d = v - mu;
+        m2 += d * d / w.size();
+        m3 += d * d * d / w.size();
+        m4 += d * d * d * d / w.size();
+        ms += v * v / w.size();
+    }
+    double pos = 0.9 * (w.size() - 1);
+    double p90 = w[(size_t)pos] + (w[(size_t)pos + 1] - w[(size_t)pos]) * (pos - (size_t)pos);
+    double max_feat_diff = std::max({
+        std::abs(features.min(hf) - w.front()),
+        std::abs(features.max(hf) - w.back()),
+        std::abs(features.peak_to_peak(hf) - (w.back() - w.front())),
+        std::abs(features.median(hf) - (w[249] + w[250]) / 2),
+        std::abs(features.percentile(hf, 90) - p90),
+        std::abs(features.rms(hf) - std::sqrt(ms)),
+        std::abs(features.crest_factor(hf) - std::max(w.back(), -w.front()) / std::sqrt(ms)),
+        std::abs(features.skewness(hf) - m3 / std::pow(m2, 1.5)),
+        std::abs(features.kurtosis(hf) - m4 / (m2 * m2))});
+    // same percentiles without the tree
+    double p90_tree = features.percentile(hf, 90);
+    features.set_quantiles(false);
+    max_feat_diff = std::max(max_feat_diff, std::abs(features.percentile(hf, 90) - p90_tree));
+    features.add(hf, signal[2000]);
+    // long run on a signal with a large DC offset: the sliding statistics
+    // must match the two-pass ones on the final window
+    MovingWindowStats drift(100, MovingWindowStats::on_demand);
+    auto hd = drift.channel("drift");
+    std::vector<double> last(100);
+    for (size_t i = 0; i < 2000000; i++) {
+        double val = 1.0e6 + std::sin(0.1 * i) + 1.0e-3 * ((rand() % 100) / 100.0 - 0.5);
+        last[i % 100] = val;
+        drift.add(hd, val);
+    }
+    double dmean = 0, dvar = 0;
+    for (auto v : last) dmean += v / 100;
+    for (auto v : last) dvar += (v - dmean) * (v - dmean) / 100;
+    double drift_err = std::abs(drift.stdev(hd) - std::sqrt(dvar)) / std::sqrt(dvar);
+    std::cout << "Relative stdev error after 2e6 samples with 1e6 offset: " << drift_err << "\n";
+
+    // monotonic ramps keep the whole window in one of the deques
+    MovingWindowStats ramps(8);
+    auto hr = ramps.channel("rising"), hfall = ramps.channel("falling");
+    for (size_t i = 0; i < 37; i++) {
+        ramps.add(hr, (double)i);
+        ramps.add(hfall, 36.0 - i);
+    }
+    max_feat_diff = std::max({max_feat_diff,
+        std::abs(ramps.min(hr) - 29), std::abs(ramps.max(hr) - 36),
+        std::abs(ramps.min(hfall) - 0), std::abs(ramps.max(hfall) - 7)});
+    std::cout << "Ramps, window 8: rising min " << ramps.min(hr) << " max "
+              << ramps.max(hr) << ", falling min " << ramps.min(hfall)
+              << " max " << ramps.max(hfall) << "\n";
+
+    std::cout << "Features: min " << features.min(hf) << " max " << features.max(hf)
+              << " median " << features.median(hf) << " kurtosis " << features.kurtosis(hf)
+              << ", max deviation " << max_feat_diff << "\n";
+
     std::cout << "FFT Magnitudes (first 20 bins): ";
     const auto& fft_vals = stats.fft(key);
     std::cout << std::fixed << std::setprecision(4);
@@ -109,6 +551,8 @@ int main() {
         std::cout << fft_vals[i] << " ";
     std::cout << "\n";
 
-    return 0;
+    return max_diff < 1e-9 && max_dft_diff < 1e-9 && max_lazy_diff < 1e-9 &&
+           max_batch_diff < 1e-9 && max_feat_diff < 1e-9 &&
+           drift_err < 1e-9 ? 0 : 1;
 }
 #endif
\ No newline at end of file
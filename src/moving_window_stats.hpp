@@ -1,50 +1,223 @@
-#include <deque>
+#include <cmath>
+#include <complex>
 #include <map>
+#include <memory>
+#include <span>
 #include <vector>
 #include <unordered_map>
 #include <string>
+#include "fft.h"
+#include "order_statistics.hpp"
+
+// Below this window size ACF and spectrum are computed directly (O(N^2)),
+// above it via zero-padded FFT (O(N log N))
+#define ACF_FFT_MIN_SIZE 64
 
 class MovingWindowStats {
 public:
-  MovingWindowStats(size_t size = 0) : _size(size){};
+  // Compact identifier of a registered signal (index into the channel table)
+  using handle = size_t;
+
+  // hop value for computing ACF and spectrum only when they are read
+  static constexpr size_t on_demand = 0;
+
+  // ACF and spectrum are updated every `hop` samples once the window is full
+  // (1: at each sample), or only when read if hop is on_demand
+  MovingWindowStats(size_t size = 0, size_t hop = 1) : _size(size), _hop(hop){};
 
+  // set a new window size; registered signals (and their handles) are kept,
+  // but all their data are cleared
   void reset(size_t size) {
+    if (size != _size) {
+      _plan.reset();
+      _chirp.clear();
+    }
     _size = size;
-    _mean.clear();
-    _stdev.clear();
-    _signal_buffers.clear();
-    _signal_acf.clear();
-    _signal_fft.clear();
-    _sum.clear();
-    _sum_sq.clear();
+    for (auto &ch : _channels) ch.clear(_size, _quantiles);
   }
 
-  // append a new value to a given signal according to key; calculate acf and
-  // fft in _signal_stats only if the fuffer is full, calculate _mean and _stdev
-  // regardless the number of elements in the buffer
-  bool add(std::string const key, double value);
+  size_t size() const { return _size; }
+  size_t hop() const { return _hop; }
+  void set_hop(size_t hop) { _hop = hop; }
 
-  bool is_full(std::string const &key) { return _signal_buffers[key].size() >= _size; }
+  // keep an order-statistic tree per signal, making median() and
+  // percentile() O(log N) at the cost of O(log N) per added sample; when
+  // disabled, they select on a copy of the window in O(N)
+  bool quantiles() const { return _quantiles; }
+  void set_quantiles(bool on) {
+    if (on && !_quantiles) {
+      for (auto &ch : _channels) {
+        ch.quant.reset(_size);
+        for (size_t i = 0; i < ch.count; i++)
+          ch.quant.insert(ch.window(i), ch.samples - ch.count + i);
+      }
+    } else if (!on) {
+      for (auto &ch : _channels) ch.quant.reset(0);
+    }
+    _quantiles = on;
+  }
+
+  // register a signal once and get its handle; returns the existing handle if
+  // the key is already registered
+  handle channel(std::string const &key) {
+    auto it = _handles.find(key);
+    if (it != _handles.end()) return it->second;
+    _channels.emplace_back();
+    _channels.back().clear(_size, _quantiles);
+    return _handles[key] = _channels.size() - 1;
+  }
+
+  // append a new value to a given signal; calculate acf and fft only if the
+  // buffer is full, calculate mean and stdev regardless the number of
+  // elements in the buffer
+  bool add(handle h, double value);
+  bool add(std::string const &key, double value) {
+    return add(channel(key), value);
+  }
+
+  // append a block of values to a given signal in one pass; ACF and spectrum
+  // are refreshed (according to hop) once, at the end of the block
+  bool add(handle h, std::span<const double> values);
+
+  // append a whole acquisition batch (e.g. Acquisitor<T>::data()):
+  // sample.data[i] goes to signal channels[i]. Returns true if all the
+  // signals are full
+  template <typename Sample>
+  bool add_batch(std::vector<Sample> const &batch,
+                 std::vector<handle> const &channels) {
+    bool full = true;
+    _gather.resize(batch.size());
+    for (size_t c = 0; c < channels.size(); c++) {
+      for (size_t i = 0; i < batch.size(); i++) _gather[i] = batch[i].data[c];
+      full = add(channels[c], std::span<const double>(_gather)) && full;
+    }
+    return full;
+  }
 
-  std::vector<double> &acf(std::string const &key) { return _signal_acf[key]; };
-  std::vector<double> &fft(std::string const &key) { return _signal_fft[key]; };
-  double mean(std::string const &key) { return _mean[key]; };
-  double stdev(std::string const &key) { return _stdev[key]; };
+  bool is_full(handle h) const { return _channels[h].count >= _size; }
+  // in on_demand mode, these compute the result if new samples arrived since
+  // the last call
+  std::vector<double> &acf(handle h) {
+    auto &ch = _channels[h];
+    if (_hop == on_demand && is_full(h) && ch.acf_at != ch.samples)
+      calculate_acf(ch);
+    return ch.acf;
+  };
+  std::vector<double> &fft(handle h) {
+    auto &ch = _channels[h];
+    if (_hop == on_demand && is_full(h) && ch.fft_at != ch.samples)
+      calculate_fft(ch);
+    return ch.fft;
+  };
+  // total number of samples added to a signal, and sample count at which
+  // ACF and spectrum were last computed (0: never)
+  size_t samples(handle h) const { return _channels[h].samples; }
+  size_t acf_index(handle h) const { return _channels[h].acf_at; }
+  size_t fft_index(handle h) const { return _channels[h].fft_at; }
+
+  // windowed features, updated at each sample
+  double min(handle h) const { return _channels[h].min_q.front(); }
+  double max(handle h) const { return _channels[h].max_q.front(); }
+  double peak_to_peak(handle h) const { return max(h) - min(h); }
+  double rms(handle h) const { return _channels[h].rms; }
+  double crest_factor(handle h) const {
+    double peak = std::max(std::abs(max(h)), std::abs(min(h)));
+    return _channels[h].rms > 0 ? peak / _channels[h].rms : 0.0;
+  }
+  double skewness(handle h) const { return _channels[h].skewness; }
+  // non-excess kurtosis (3 for a normal distribution)
+  double kurtosis(handle h) const { return _channels[h].kurtosis; }
+  // p-th percentile (0 to 100), interpolated between closest ranks
+  double percentile(handle h, double p);
+  double median(handle h) { return percentile(h, 50); }
+  double mean(handle h) const { return _channels[h].mean; };
+  double stdev(handle h) const { return _channels[h].stdev; };
+  double st_uncertainty(handle h) const {
+    return _channels[h].stdev / std::sqrt(_size);
+  };
+
+  // string API: thin wrappers that look the handle up (registering the key
+  // on first use)
+  bool is_full(std::string const &key) { return is_full(channel(key)); }
+  std::vector<double> &acf(std::string const &key) { return acf(channel(key)); };
+  std::vector<double> &fft(std::string const &key) { return fft(channel(key)); };
+  double mean(std::string const &key) { return mean(channel(key)); };
+  double stdev(std::string const &key) { return stdev(channel(key)); };
   double st_uncertainty(std::string const &key) {
-    return _stdev[key] / std::sqrt(_size);
+    return st_uncertainty(channel(key));
   };
+  size_t samples(std::string const &key) { return samples(channel(key)); }
+  double min(std::string const &key) { return min(channel(key)); }
+  double max(std::string const &key) { return max(channel(key)); }
+  double peak_to_peak(std::string const &key) { return peak_to_peak(channel(key)); }
+  double rms(std::string const &key) { return rms(channel(key)); }
+  double crest_factor(std::string const &key) { return crest_factor(channel(key)); }
+  double skewness(std::string const &key) { return skewness(channel(key)); }
+  double kurtosis(std::string const &key) { return kurtosis(channel(key)); }
+  double percentile(std::string const &key, double p) { return percentile(channel(key), p); }
+  double median(std::string const &key) { return median(channel(key)); }
 
 private:
+  // All the state of a signal. Samples live in a fixed-capacity ring:
+  // `head` is the oldest sample, window[i] the i-th oldest
+  struct Channel {
+    std::vector<double> ring;
+    size_t head = 0, count = 0;
+    size_t samples = 0;            // total samples added
+    size_t acf_at = 0, fft_at = 0; // value of samples when last computed
+    double shift = 0;      // reference value, close to the mean
+    double sum[4] = {0};   // power sums of d, d^2, d^3, d^4 with d = x - shift
+    double sum_c[4] = {0}; // their compensation terms
+    size_t since_exact = 0; // samples since sums were recomputed from ring
+    double mean = 0, stdev = 0;
+    double rms = 0, skewness = 0, kurtosis = 0;
+    MonotonicDeque<true> min_q;
+    MonotonicDeque<false> max_q;
+    OrderStatistics quant;
+    std::vector<double> acf, fft;
+    // Sliding DFT: complex bins (first N/2) and number of sliding updates
+    // since they were last computed exactly
+    std::vector<std::complex<double>> dft;
+    size_t dft_slides = 0;
+
+    void clear(size_t capa, bool quantiles) {
+      *this = Channel();
+      ring.assign(capa, 0.0);
+      min_q.reset(capa);
+      max_q.reset(capa);
+      quant.reset(quantiles ? capa : 0);
+    }
+    double window(size_t i) const {
+      size_t j = head + i;
+      return ring[j < ring.size() ? j : j - ring.size()];
+    }
+  };
+
   size_t _size;
-  std::unordered_map<std::string, double> _mean;
-  std::unordered_map<std::string, double> _stdev;
+  size_t _hop;
+  bool _quantiles = false;
+  std::unordered_map<std::string, handle> _handles;
+  std::vector<Channel> _channels;
+
+  // e^(j2pi k/N) twiddles for the DFT, shared by all signals
+  std::vector<std::complex<double>> _twiddles;
 
-  std::unordered_map<std::string, std::deque<double>> _signal_buffers;
-  std::unordered_map<std::string, std::vector<double>> _signal_acf;
-  std::unordered_map<std::string, std::vector<double>> _signal_fft;
-  std::unordered_map<std::string, double> _sum;
-  std::unordered_map<std::string, double> _sum_sq;
+  // ACF and exact spectrum via FFT: plan of size >= 2N, chirp-z sequence and
+  // its transform, scratch buffers; shared by all signals, since they only
+  // depend on the window size
+  std::unique_ptr<fft_plan_t, void (*)(fft_plan_t *)> _plan{nullptr, fft_plan_free};
+  std::vector<std::complex<double>> _chirp;
+  std::vector<double> _chirp_re, _chirp_im;
+  std::vector<double> _work_re, _work_im;
+  std::vector<double> _gather; // one channel of a batch, made contiguous
 
-  void calculate_acf(std::string const &key);
-  void calculate_fft(std::string const &key);
+  void update_stats(Channel &ch);
+  void recompute_sums(Channel &ch);
+  void update_order(Channel &ch, size_t idx, double value, bool evict, double old);
+  void prepare_plan(size_t N);
+  void calculate_acf(Channel &ch);
+  void calculate_acf_direct(Channel &ch);
+  void calculate_fft(Channel &ch);
+  void calculate_fft_direct(Channel &ch);
+  void slide_fft(Channel &ch, double in, double out);
 };
\ No newline at end of file
@@ -0,0 +1,168 @@
+/*
+   ___          _             _        _
+  / _ \ _ __ __| | ___ _ __  | |_ __ _| |_ ___
+ | | | | '__/ _` |/ _ \ '__| | __/ _` | __/ __|
+ | |_| | | | (_| |  __/ |    | || (_| | |_\__ \
+  \___/|_|  \__,_|\___|_|     \__\__,_|\__|___/
+
+Incremental order statistics over a sliding window of bounded size:
+- MonotonicDeque: running minimum or maximum in amortized O(1) per sample
+- OrderStatistics: k-th smallest value (median, percentiles) in O(log w)
+Both live in storage allocated once for the window capacity, so that no
+allocation happens per sample.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Monotonic deque of (sample index, value): the front is the extremum of the
+// window. With Less = true it tracks the minimum, otherwise the maximum; on
+// ties the oldest sample stays at the front.
+template <bool Less>
+class MonotonicDeque {
+public:
+  void reset(size_t capacity) {
+    _buf.assign(capacity > 0 ? capacity : 1, {0, 0.0});
+    _front = _count = 0;
+  }
+
+  // add the newest sample, dropping those it dominates; expire() the samples
+  // leaving the window first, so that the new one fits in the capacity
+  void push(size_t idx, double v) {
+    while (_count > 0 && dominated(back().second, v)) _count--;
+    _buf[(_front + _count++) % _buf.size()] = {idx, v};
+  }
+
+  // drop samples older than first_idx (i.e. out of the window)
+  void expire(size_t first_idx) {
+    while (_count > 0 && _buf[_front].first < first_idx) {
+      _front = (_front + 1) % _buf.size();
+      _count--;
+    }
+  }
+
+  bool empty() const { return _count == 0; }
+  double front() const { return _buf[_front].second; }
+
+private:
+  std::vector<std::pair<size_t, double>> _buf;
+  size_t _front = 0, _count = 0;
+
+  std::pair<size_t, double> const &back() const {
+    return _buf[(_front + _count - 1) % _buf.size()];
+  }
+  static bool dominated(double old, double v) { return Less ? v < old : v > old; }
+};
+
+
+// Order-statistic tree: a treap with subtree sizes, keyed by (value, sample
+// index) so that equal values can be told apart when they leave the window.
+// Nodes come from a pool sized at reset(); node 0 is the null node.
+class OrderStatistics {
+public:
+  void reset(size_t capacity) {
+    _n.assign(capacity + 1, Node{});
+    _free.clear();
+    for (size_t i = capacity; i > 0; i--) _free.push_back((uint32_t)i);
+    _root = 0;
+  }
+
+  void insert(double v, size_t id) {
+    if (_free.empty()) return;
+    uint32_t t = _free.back(), l, r;
+    _free.pop_back();
+    _n[t] = Node{v, id, next_prio(), 0, 0, 1};
+    split(_root, v, id, l, r);
+    _root = merge(merge(l, t), r);
+  }
+
+  void erase(double v, size_t id) { _root = erase(_root, v, id); }
+
+  size_t size() const { return _n[_root].size; }
+
+  // k-th smallest value (0-based), k < size()
+  double kth(size_t k) const {
+    uint32_t t = _root;
+    while (t) {
+      size_t ls = _n[_n[t].l].size;
+      if (k < ls) {
+        t = _n[t].l;
+      } else if (k == ls) {
+        return _n[t].v;
+      } else {
+        k -= ls + 1;
+        t = _n[t].r;
+      }
+    }
+    return 0.0;
+  }
+
+private:
+  struct Node {
+    double v = 0;
+    size_t id = 0;
+    uint32_t prio = 0, l = 0, r = 0, size = 0;
+  };
+  std::vector<Node> _n;
+  std::vector<uint32_t> _free;
+  uint32_t _root = 0;
+  uint32_t _seed = 2463534242u;
+
+  uint32_t next_prio() { // xorshift32
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+  }
+  static bool less(double v1, size_t i1, double v2, size_t i2) {
+    return v1 < v2 || (v1 == v2 && i1 < i2);
+  }
+  void update(uint32_t t) { _n[t].size = 1 + _n[_n[t].l].size + _n[_n[t].r].size; }
+
+  // l gets the keys lower than (v, id), r the others
+  void split(uint32_t t, double v, size_t id, uint32_t &l, uint32_t &r) {
+    if (!t) {
+      l = r = 0;
+      return;
+    }
+    if (less(_n[t].v, _n[t].id, v, id)) {
+      split(_n[t].r, v, id, _n[t].r, r);
+      l = t;
+    } else {
+      split(_n[t].l, v, id, l, _n[t].l);
+      r = t;
+    }
+    update(t);
+  }
+
+  uint32_t merge(uint32_t a, uint32_t b) {
+    if (!a) return b;
+    if (!b) return a;
+    if (_n[a].prio > _n[b].prio) {
+      _n[a].r = merge(_n[a].r, b);
+      update(a);
+      return a;
+    }
+    _n[b].l = merge(a, _n[b].l);
+    update(b);
+    return b;
+  }
+
+  uint32_t erase(uint32_t t, double v, size_t id) {
+    if (!t) return 0;
+    if (_n[t].v == v && _n[t].id == id) {
+      uint32_t m = merge(_n[t].l, _n[t].r);
+      _free.push_back(t);
+      return m;
+    }
+    if (less(v, id, _n[t].v, _n[t].id))
+      _n[t].l = erase(_n[t].l, v, id);
+    else
+      _n[t].r = erase(_n[t].r, v, id);
+    update(t);
+    return t;
+  }
+};
@@ -36,6 +36,7 @@
 
 #include "fft.h"
 #include <stdio.h>
+#include <string.h>
 #define FULL    0
 #define PARTIAL 1
 
@@ -78,11 +79,61 @@ static void compute_stats(fft_data_t * const d, index_t start, char type, statis
   stat->sd = sqrt(acc / (c - 1));
 }
 
+// Sliding window over [start, start + win_size) of the spectrum magnitude.
+// Sums are shifted by the overall mean to limit cancellation in the variance;
+// the maximum is tracked with a monotonic deque of indices (decreasing values,
+// leftmost first on ties). Each bin enters and leaves the window once, so a
+// whole scan is O(n) regardless of win_size.
+typedef struct sliding_window {
+  data_t   shift;
+  data_t   sum;
+  data_t   sum_sq;
+  index_t  size;
+  index_t *deque;
+  size_t   front, back;
+} sliding_window_t;
+
+static void window_push(fft_data_t * const d, sliding_window_t * const w, index_t i) {
+  const data_t v = fft_x(d)[i];
+  const data_t s = v - w->shift;
+  w->sum    += s;
+  w->sum_sq += s * s;
+  while (w->back > w->front && fft_x(d)[w->deque[w->back - 1]] < v)
+    w->back--;
+  w->deque[w->back++] = i;
+}
+
+static void window_pop(fft_data_t * const d, sliding_window_t * const w, index_t i) {
+  const data_t s = fft_x(d)[i] - w->shift;
+  w->sum    -= s;
+  w->sum_sq -= s * s;
+  if (w->back > w->front && w->deque[w->front] == i)
+    w->front++;
+}
+
+static void window_stats(fft_data_t * const d, sliding_window_t * const w, statistics_t * const stat) {
+  const data_t m   = w->sum / w->size;
+  data_t       var = (w->sum_sq - w->sum * m) / (w->size - 1);
+  if (var < 0) var = 0; // numerical guard
+  stat->mean = m + w->shift;
+  stat->sd   = sqrt(var);
+  stat->max  = 0.;
+  // same as compute_stats(): the max (and its index) only updates when > 0
+  if (fft_x(d)[w->deque[w->front]] > stat->max) {
+    stat->max     = fft_x(d)[w->deque[w->front]];
+    stat->max_idx = w->deque[w->front];
+  }
+}
+
 index_t fft_search_peaks(fft_data_t * const d, index_t max_peaks) {
   index_t count   = 0;
   FILE *of = NULL;
   // index_t peaks_s = CHUNK_SIZE;
-  statistics_t stat;
+  statistics_t stat = {0};
+  sliding_window_t win;
+  const index_t half = fft_nbins(d);
+  const index_t ws   = fft_win_size(d);
+  const index_t last = half > ws ? half - ws : 0;
 
   if (fft_realloc_peaks(d, max_peaks) == NULL) {
     fprintf(stderr, "Memory allocation error in peaksearch\n");
@@ -97,33 +148,106 @@ index_t fft_search_peaks(fft_data_t * const d, index_t max_peaks) {
   compute_stats(d, 0, FULL, &stat);
   fft_set_stdev(d, stat.sd);
 
+  memset(&win, 0, sizeof(win));
+  win.shift = stat.mean;
+  win.size  = ws;
+  win.deque = (index_t *)malloc((half + 1) * sizeof(index_t));
+  if (win.deque == NULL) {
+    fprintf(stderr, "Memory allocation error in peaksearch\n");
+    if (of) fclose(of);
+    return 0;
+  }
+
   index_t i;
   char in_cluster = 0;
+  char found = 0; // the current cluster has stored a (new) peak
 
   data_t max = 0.;
-  // run only on the first half of the FFT (it is symmetric!)
-  for(i = 0; i < ((fft_n(d) / 2) - fft_win_size(d)); i++) {
-    compute_stats(d, i, PARTIAL, &stat);
+  // run only on the first half of the FFT (it is symmetric!), or on the
+  // whole band with zoom
+  for (i = 0; i < ws && last > 0; i++)
+    window_push(d, &win, i);
+  for(i = 0; i < last; i++) {
+    if (i > 0) {
+      window_pop(d, &win, i - 1);
+      window_push(d, &win, i + ws - 1);
+    }
+    window_stats(d, &win, &stat);
     if (stat.sd > fft_nsigma(d) * fft_stdev(d)) {
-      if (stat.max > max && fft_peaks(d)[count-1] != stat.max_idx) {
+      if (stat.max > max && (count == 0 || fft_peaks(d)[count-1] != stat.max_idx)) {
         fft_peaks(d)[count] = stat.max_idx;
         max = stat.max;
+        found = 1;
       }
       in_cluster = 1;
     }
     else {
-      if(in_cluster == 1) count++;
-      if(count > max_peaks) {
+      // a cluster that only re-found the previous peak is not a new one
+      if(in_cluster == 1 && found) count++;
+      if(count >= max_peaks) {
         break;
         // peaks_s += CHUNK_SIZE;
         // fft_peaks(d) = (index_t*) realloc(fft_peaks(d), peaks_s * sizeof(index_t));
       }
       max = 0.;
       in_cluster = 0;
+      found = 0;
     }
     if (of) fprintf(of, "%d\t%f\t%f\t%f\t%d\n", i, fft_x(d)[i], stat.sd, stat.sd / fft_stdev(d), in_cluster);
   }
+  free(win.deque);
   if (of) fclose(of);
   fft_set_npeaks(d, count);
+  fft_interpolate_peaks(d);
   return count;
 }
+
+static data_t sinc(data_t x) {
+  return x == 0 ? 1. : sin(M_PI * x) / (M_PI * x);
+}
+
+// Estimate the true frequency and amplitude of each peak from the magnitudes
+// of the peak bin c and of its neighbours l and r. The window shapes the main
+// lobe, so the estimator depends on it:
+// - rectangular (no window): |W(d)| = sinc(d), exact two-point solution
+//   d = b / (b + c), with b the larger neighbour
+// - Hann: |W(d)| = sinc(d) / (1 - d^2), exact two-point solution
+//   d = (2b - c) / (b + c)
+// - others (Hamming, Blackman): the main lobe is close to a Gaussian, so
+//   fit a parabola to the log-magnitudes
+void fft_interpolate_peaks(fft_data_t * const d) {
+  const data_t *x = fft_x(d);
+  const data_t f0 = fft_f(d)[0], df = fft_f(d)[1] - f0;
+  const fft_windowing w = fft_window(d);
+  index_t i, k;
+  for (i = 0; i < fft_npeaks(d); i++) {
+    data_t delta = 0., ampl;
+    k = fft_peaks(d)[i];
+    ampl = x[k];
+    if (k > 0 && k + 1 < fft_nbins(d) && x[k] > 0) {
+      const data_t l = x[k - 1], c = x[k], r = x[k + 1];
+      if (w == NULL || w == hann) {
+        const data_t b = r > l ? r : l;
+        if (w == NULL) {
+          delta = b / (b + c);
+        } else {
+          delta = (2 * b - c) / (b + c);
+        }
+        if (delta < 0) delta = 0;
+        if (delta > 0.5) delta = 0.5;
+        ampl = c / sinc(delta);
+        if (w == hann) ampl *= 1 - delta * delta;
+        if (l > r) delta = -delta;
+      } else if (l > 0 && r > 0) {
+        const data_t ll = log(l), lc = log(c), lr = log(r);
+        const data_t den = ll - 2 * lc + lr;
+        if (den < 0) {
+          delta = 0.5 * (ll - lr) / den;
+          ampl = exp(lc - 0.25 * (ll - lr) * delta);
+        }
+      }
+    }
+    fft_peaks_f(d)[i] = f0 + (k + delta) * df;
+    fft_peaks_a(d)[i] = ampl;
+  }
+}
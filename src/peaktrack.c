@@ -0,0 +1,210 @@
+/******************************************************************************\
+ _____ _____ _____         _   _ _ _ _   _
+|  ___|  ___|_   _|  _   _| |_(_) (_) |_(_) ___  ___
+| |_  | |_    | |   | | | | __| | | | __| |/ _ \/ __|
+|  _| |  _|   | |   | |_| | |_| | | | |_| |  __/\__ \
+|_|   |_|     |_|    \__,_|\__|_|_|_|\__|_|\___||___/
+
+==============================================================================
+ File:         peaktrack.c
+ LICENSE:      MIT
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the "Software"), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+\******************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "peaktrack.h"
+
+#define DEFAULT_RESCAN     10 // frames between full peak searches
+#define DEFAULT_MAX_MISSED 3  // frames before a lost track is dropped
+
+typedef struct fft_tracker {
+  fft_track_t *tracks;     // active tracks, first n_tracks are valid
+  index_t      max_tracks; // allocated tracks
+  index_t      n_tracks;   // active tracks
+  index_t      radius;     // local search half-width, in bins
+  index_t      rescan;     // frames between full searches
+  index_t      max_missed; // drop a track after this many missed frames
+  index_t      frame;      // frames since last full search
+  unsigned     next_id;    // id of the next new track
+  int          rescanned;  // last update ran a full search
+  char        *matched;    // per-peak flag used during association
+} fft_tracker_t;
+
+fft_tracker_t *fft_tracker_init(index_t max_tracks, index_t radius) {
+  fft_tracker_t *t = (fft_tracker_t *)malloc(sizeof(fft_tracker_t));
+  if (t == NULL) {
+    perror("fft_tracker malloc error");
+    exit(EXIT_FAILURE);
+  }
+  memset(t, 0, sizeof(fft_tracker_t));
+  t->max_tracks = max_tracks;
+  t->radius = radius;
+  t->rescan = DEFAULT_RESCAN;
+  t->max_missed = DEFAULT_MAX_MISSED;
+  t->tracks = (fft_track_t *)malloc(max_tracks * sizeof(fft_track_t));
+  t->matched = (char *)malloc(max_tracks * sizeof(char));
+  if (t->tracks == NULL || t->matched == NULL) {
+    perror("fft_tracker malloc error");
+    exit(EXIT_FAILURE);
+  }
+  fft_tracker_reset(t);
+  return t;
+}
+
+void fft_tracker_free(fft_tracker_t *t) {
+  assert(t != NULL);
+  free(t->tracks);
+  free(t->matched);
+  free(t);
+}
+
+void fft_tracker_reset(fft_tracker_t *t) {
+  memset(t->tracks, 0, t->max_tracks * sizeof(fft_track_t));
+  t->n_tracks = 0;
+  t->frame = 0;
+  t->rescanned = 0;
+}
+
+// Update a track with a new (interpolated) observation
+static void track_hit(fft_track_t *tr, data_t freq, data_t ampl) {
+  if (tr->age > 0)
+    tr->dfreq = 0.5 * tr->dfreq + 0.5 * (freq - tr->freq);
+  tr->freq = freq;
+  tr->ampl = ampl;
+  tr->age++;
+  tr->missed = 0;
+}
+
+// Remove tracks that have been missing for too long, keeping the order
+static void drop_lost(fft_tracker_t *t) {
+  index_t i, j;
+  for (i = 0, j = 0; i < t->n_tracks; i++) {
+    if (t->tracks[i].missed <= t->max_missed)
+      t->tracks[j++] = t->tracks[i];
+  }
+  t->n_tracks = j;
+}
+
+// Local search: the highest bin within radius of the predicted position
+// must be a local maximum above the threshold of the last full search.
+// Returns 0 if the track is lost in this frame
+static int local_search(fft_tracker_t *t, fft_data_t *d, fft_track_t *tr,
+                        index_t *bin) {
+  const data_t *x = fft_x(d);
+  const data_t f0 = fft_f(d)[0], df = fft_f(d)[1] - f0;
+  const long half = fft_nbins(d);
+  const long p = lround((tr->freq + tr->dfreq - f0) / df);
+  long lo = p - t->radius, hi = p + t->radius, k, best;
+  if (lo < 1) lo = 1;
+  if (hi > half - 2) hi = half - 2;
+  if (lo > hi) return 0;
+  for (k = lo, best = lo; k <= hi; k++) {
+    if (x[k] > x[best]) best = k;
+  }
+  if (x[best] <= x[best - 1] || x[best] < x[best + 1]) return 0;
+  if (x[best] <= fft_nsigma(d) * fft_stdev(d)) return 0;
+  *bin = (index_t)best;
+  return 1;
+}
+
+// Full search: associate peaks to tracks by nearest predicted frequency,
+// start new tracks from the peaks left over
+static void full_search(fft_tracker_t *t, fft_data_t *d) {
+  const data_t df = fft_f(d)[1] - fft_f(d)[0];
+  index_t i, j, n = fft_search_peaks(d, t->max_tracks);
+  memset(t->matched, 0, t->max_tracks * sizeof(char));
+  for (i = 0; i < t->n_tracks; i++) {
+    fft_track_t *tr = &t->tracks[i];
+    const data_t pred = tr->freq + tr->dfreq;
+    data_t best_dist = (t->radius + 0.5) * df;
+    index_t best = n;
+    for (j = 0; j < n; j++) {
+      const data_t dist = fabs(fft_peaks_f(d)[j] - pred);
+      if (!t->matched[j] && dist <= best_dist) {
+        best_dist = dist;
+        best = j;
+      }
+    }
+    if (best < n) {
+      t->matched[best] = 1;
+      track_hit(tr, fft_peaks_f(d)[best], fft_peaks_a(d)[best]);
+    } else {
+      tr->missed++;
+    }
+  }
+  drop_lost(t);
+  for (j = 0; j < n && t->n_tracks < t->max_tracks; j++) {
+    if (t->matched[j]) continue;
+    fft_track_t *tr = &t->tracks[t->n_tracks++];
+    memset(tr, 0, sizeof(fft_track_t));
+    tr->id = t->next_id++;
+    track_hit(tr, fft_peaks_f(d)[j], fft_peaks_a(d)[j]);
+  }
+  t->frame = 0;
+  t->rescanned = 1;
+}
+
+index_t fft_tracker_update(fft_tracker_t *t, fft_data_t *d) {
+  index_t i, j;
+  int lost = 0;
+  t->rescanned = 0;
+  t->frame++;
+  if (t->n_tracks == 0 || t->frame >= t->rescan) {
+    full_search(t, d);
+    return t->n_tracks;
+  }
+  if (fft_realloc_peaks(d, t->max_tracks) == NULL) {
+    fprintf(stderr, "Memory allocation error in peaktrack\n");
+    return t->n_tracks;
+  }
+  // collect local maxima in the peaks array of d, so that they get refined
+  // exactly as the peaks of a full search
+  for (i = 0; i < t->n_tracks && !lost; i++) {
+    if (!local_search(t, d, &t->tracks[i], &fft_peaks(d)[i])) lost = 1;
+    for (j = 0; j < i && !lost; j++) {
+      if (fft_peaks(d)[j] == fft_peaks(d)[i]) lost = 1; // two tones merged
+    }
+  }
+  if (lost) {
+    full_search(t, d);
+    return t->n_tracks;
+  }
+  fft_set_npeaks(d, t->n_tracks);
+  fft_interpolate_peaks(d);
+  for (i = 0; i < t->n_tracks; i++) {
+    track_hit(&t->tracks[i], fft_peaks_f(d)[i], fft_peaks_a(d)[i]);
+  }
+  return t->n_tracks;
+}
+
+
+fft_track_t *fft_tracker_tracks(const fft_tracker_t *t) { return t->tracks; }
+index_t fft_tracker_ntracks(const fft_tracker_t *t) { return t->n_tracks; }
+int fft_tracker_rescanned(const fft_tracker_t *t) { return t->rescanned; }
+index_t fft_tracker_rescan(const fft_tracker_t *t) { return t->rescan; }
+void fft_tracker_set_rescan(fft_tracker_t *t, index_t frames) { t->rescan = frames; }
+index_t fft_tracker_max_missed(const fft_tracker_t *t) { return t->max_missed; }
+void fft_tracker_set_max_missed(fft_tracker_t *t, index_t frames) { t->max_missed = frames; }
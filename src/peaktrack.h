@@ -0,0 +1,83 @@
+/******************************************************************************\
+ _____ _____ _____         _   _ _ _ _   _
+|  ___|  ___|_   _|  _   _| |_(_) (_) |_(_) ___  ___
+| |_  | |_    | |   | | | | __| | | | __| |/ _ \/ __|
+|  _| |  _|   | |   | |_| | |_| | | | |_| |  __/\__ \
+|_|   |_|     |_|    \__,_|\__|_|_|_|\__|_|\___||___/
+
+==============================================================================
+ File:         peaktrack.h
+ LICENSE:      MIT
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the "Software"), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+\******************************************************************************/
+
+#ifndef PEAKTRACK_H
+#define PEAKTRACK_H
+
+#include "fft.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// A tone followed across successive spectra
+typedef struct fft_track {
+  unsigned id;     // unique identity, stable for the whole life of the track
+  data_t   freq;   // interpolated frequency in the last frame
+  data_t   ampl;   // interpolated amplitude in the last frame
+  data_t   dfreq;  // smoothed frequency change per frame (used for prediction)
+  index_t  age;    // number of frames since the track was born
+  index_t  missed; // consecutive frames without a match
+} fft_track_t;
+
+// Object Structure
+typedef struct fft_tracker fft_tracker_t;
+
+// Initializer&de-initializer
+// max_tracks: maximum number of tones followed at the same time
+// radius: half-width (in bins) of the local search around predictions
+fft_tracker_t *fft_tracker_init(index_t max_tracks, index_t radius);
+void fft_tracker_free(fft_tracker_t *t);
+void fft_tracker_reset(fft_tracker_t *t);
+
+// Update the tracks with a new spectrum (fft_calc_spectrum() already called,
+// win_size and nsigma set for fft_search_peaks()).
+// Tracks are searched locally around their predicted position; a full
+// fft_search_peaks() runs every `rescan` frames, when a track is lost, or
+// when there are no tracks. Returns the number of active tracks.
+index_t fft_tracker_update(fft_tracker_t *t, fft_data_t *d);
+
+// Accessors
+fft_track_t *fft_tracker_tracks(const fft_tracker_t *t);
+index_t fft_tracker_ntracks(const fft_tracker_t *t);
+int fft_tracker_rescanned(const fft_tracker_t *t);
+index_t fft_tracker_rescan(const fft_tracker_t *t);
+void fft_tracker_set_rescan(fft_tracker_t *t, index_t frames);
+index_t fft_tracker_max_missed(const fft_tracker_t *t);
+void fft_tracker_set_max_missed(fft_tracker_t *t, index_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
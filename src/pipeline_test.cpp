@@ -0,0 +1,1076 @@
+// Checks of the header-only processing stages of the buffered plugins
+#include <iostream>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+#include "acquisitor.hpp"
+#include "batch_queue.hpp"
+#include "biquad.hpp"
+#include "capacity_controller.hpp"
+#include "decimator.hpp"
+#include "features.hpp"
+#include "merger.hpp"
+#include "recorder.hpp"
+#include "replay_acq.hpp"
+#include "scaling.hpp"
+#include "timing.hpp"
+#include "trigger.hpp"
+
+using namespace std;
+
+using sample2 = Acquisitor<array<double, 2>>::sample;
+using batch2 = vector<sample2>;
+
+// n samples at rate Hz, from sample index first on, with channel values
+// f(t) and -f(t)
+static batch2 make_batch(size_t n, double rate, function<double(double)> f,
+                         size_t first = 0) {
+  batch2 b(n);
+  const auto t0 = time_point<system_clock, nanoseconds>{};
+  for (size_t i = 0; i < n; i++) {
+    double t = (first + i) / rate;
+    b[i].time = t0 + nanoseconds((int64_t)llround(t * 1e9));
+    b[i].data = {f(t), -f(t)};
+  }
+  return b;
+}
+
+// Peak amplitude of channel c, skipping the first samples of the batch
+static double amplitude(batch2 const &b, size_t skip = 0, size_t c = 0) {
+  double a = 0;
+  for (size_t i = skip; i < b.size(); i++) a = max(a, abs(b[i].data[c]));
+  return a;
+}
+
+// Overflow policies of the batch queue, its counters, and close() waking
+// up blocked producers and consumers
+static bool check_batch_queue() {
+  bool ok = true;
+  using batch = vector<int>;
+  auto fail = [&](string const &what) {
+    cout << "Batch queue: " << what << endl;
+    ok = false;
+  };
+  auto drain = [](BatchQueue<batch> &q) {
+    vector<batch> r;
+    batch b;
+    while (q.try_pop(b)) r.push_back(b);
+    return r;
+  };
+  // wait until pred() holds, for up to a second
+  auto eventually = [](function<bool()> pred) {
+    for (int i = 0; i < 1000 && !pred(); i++) this_thread::sleep_for(milliseconds(1));
+    return pred();
+  };
+
+  {
+    BatchQueue<batch> q(2, overflow_policy::drop_oldest);
+    for (int i = 1; i <= 4; i++) q.push({i});
+    if (drain(q) != vector<batch>{{3}, {4}} || q.dropped() != 2 || q.high_water() != 2)
+      fail("drop_oldest");
+  }
+  {
+    BatchQueue<batch> q(2, overflow_policy::drop_newest);
+    for (int i = 1; i <= 4; i++) q.push({i});
+    if (drain(q) != vector<batch>{{1}, {2}} || q.dropped() != 2 || q.high_water() != 2)
+      fail("drop_newest");
+  }
+  {
+    // the two oldest batches merged, every other sample
+    BatchQueue<batch> q(2, overflow_policy::decimate);
+    q.push({1, 2, 3});
+    q.push({4, 5});
+    q.push({6});
+    q.push({7, 8});
+    if (drain(q) != vector<batch>{{1, 5}, {7, 8}} || q.decimated() != 2 ||
+        q.dropped() != 0 || q.high_water() != 2)
+      fail("decimate");
+  }
+  {
+    // depth 1: the queued batch merged with the incoming one
+    BatchQueue<batch> q(1, overflow_policy::decimate);
+    q.push({1, 2, 3});
+    q.push({4, 5, 6, 7});
+    if (drain(q) != vector<batch>{{1, 3, 5, 7}} || q.decimated() != 1 || q.high_water() != 1)
+      fail("decimate at depth 1");
+  }
+  {
+    // block: the producer waits for the consumer, nothing is lost
+    BatchQueue<batch> q(2, overflow_policy::block);
+    q.push({1});
+    q.push({2});
+    bool pushed = false;
+    thread producer([&] { pushed = q.push({3}); });
+    bool stalled = eventually([&] { return q.stalls() == 1; });
+    batch b;
+    q.pop(b);
+    producer.join();
+    if (!stalled || !pushed || b != batch{1} || drain(q) != vector<batch>{{2}, {3}} ||
+        q.dropped() != 0 || q.high_water() != 2)
+      fail("block");
+  }
+  {
+    // close() wakes up a blocked producer and a blocked consumer
+    BatchQueue<batch> full(1, overflow_policy::block), empty(1);
+    full.push({1});
+    bool pushed = true, popped = true;
+    thread producer([&] { pushed = full.push({2}); });
+    thread consumer([&] {
+      batch b;
+      popped = empty.pop(b);
+    });
+    eventually([&] { return full.stalls() == 1; });
+    this_thread::sleep_for(milliseconds(10));
+    full.close();
+    empty.close();
+    producer.join();
+    consumer.join();
+    batch b;
+    if (pushed || popped || empty.try_pop(b)) fail("close() with blocked push and pop");
+    // queued batches can still be popped once closed, new ones are rejected
+    bool drained = full.pop(b) && b == batch{1} && !full.pop(b) && !full.try_pop(b);
+    if (!drained || full.push({3})) fail("closed queue");
+    full.open();
+    if (!full.push({3}) || !full.try_pop(b) || b != batch{3}) fail("reopened queue");
+  }
+  return ok;
+}
+
+// Acquisitor taking 5 ms per sample, with the sample count on channel 0
+class SlowAcquisitor : public Acquisitor<array<double, 2>> {
+public:
+  using Acquisitor::Acquisitor;
+  ~SlowAcquisitor() { stop(); }
+
+  void acquire() override {
+    if (is_full()) throw AcquisitorException();
+    this_thread::sleep_for(milliseconds(5));
+    _data.push_back({time_point_cast<nanoseconds>(system_clock::now()), {double(_count++), 0}});
+  }
+
+private:
+  size_t _count = 0;
+};
+
+// Partial batches: with max_batch_latency_ms, a batch is pushed (and
+// counted as flushed) once its oldest sample is that old, even if shorter
+// than the capacity; without it, only full batches
+static bool check_batch_latency() {
+  bool ok = true;
+  auto run = [](json settings, size_t batches) {
+    SlowAcquisitor acq(settings);
+    BatchQueue<SlowAcquisitor::batch> q(4);
+    acq.start(q);
+    vector<SlowAcquisitor::batch> r(batches);
+    for (auto &b : r) q.pop(b);
+    acq.stop();
+    return make_pair(r, acq.flushed());
+  };
+  {
+    auto [r, flushed] = run(json{{"capacity", 100}, {"max_batch_latency_ms", 30.0}}, 3);
+    bool good = flushed >= 3;
+    double next = 0;
+    for (auto const &b : r) {
+      // from the oldest sample, at least 30 ms and at most one more sample
+      double span = b.empty() ? 0 : b.back().time_since(b.front().time) * 1000;
+      good = good && !b.empty() && b.size() < 100 && span >= 25 && span < 30 + 20 &&
+             b.front().data[0] == next;
+      next += b.size();
+    }
+    if (!good) {
+      cout << "Batch latency: " << flushed << " flushed, sizes";
+      for (auto const &b : r) cout << " " << b.size();
+      cout << endl;
+      ok = false;
+    }
+  }
+  {
+    auto [r, flushed] = run(json{{"capacity", 10}, {"max_batch_latency_ms", 0.0}}, 2);
+    if (flushed != 0 || r[0].size() != 10 || r[1].size() != 10 || r[1][0].data[0] != 10) {
+      cout << "Batch latency: " << flushed << " flushed without a latency limit" << endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// Gain of a filter at f Hz (sample rate rate), from the sine and cosine
+// components of the steady-state response to a unit tone
+static double gain(BiquadCascade<sample2> &filter, double f, double rate) {
+  filter.reset();
+  const size_t n = 20000, m = 10000;
+  batch2 b = make_batch(n, rate, [f](double t) { return sin(2 * M_PI * f * t); });
+  filter.process(b);
+  double s = 0, c = 0;
+  for (size_t i = n - m; i < n; i++) {
+    s += b[i].data[0] * sin(2 * M_PI * f * i / rate);
+    c += b[i].data[0] * cos(2 * M_PI * f * i / rate);
+  }
+  return 2 * hypot(s, c) / m;
+}
+
+// Biquad cascades at 1 kHz: -3 dB at the cutoff of lowpass and highpass
+// (Butterworth, orders 2 and 4) and dcblock, 0 dB at the center and -3 dB at
+// the band edges for bandpass; no DC through dcblock; state kept across
+// batches; invalid orders and cutoffs rejected
+static bool check_biquad() {
+  bool ok = true;
+  const double rate = 1000.0, fc = 100.0, m3db = M_SQRT1_2;
+  auto expect = [&](char const *what, double got, double want, double tol) {
+    if (abs(got - want) > tol) {
+      cout << "Biquad " << what << ": gain " << got << ", expected " << want << endl;
+      ok = false;
+    }
+  };
+  for (string type : {"lowpass", "highpass"}) {
+    for (int order : {2, 4}) {
+      BiquadCascade<sample2> bq(json{
+          {"sample_rate", rate},
+          {"filters", {{{"type", type}, {"cutoff", fc}, {"order", order}}}}});
+      expect(type.c_str(), gain(bq, fc, rate), m3db, 1e-3);
+      expect(type.c_str(), gain(bq, type == "lowpass" ? 10.0 : 400.0, rate), 1.0, 1e-3);
+    }
+  }
+  {
+    const double Q = 2.0, w0 = 2 * M_PI * fc / rate;
+    const double alpha = sin(w0) / (2 * Q);
+    BiquadCascade<sample2> bq(json{
+        {"sample_rate", rate},
+        {"filters", {{{"type", "bandpass"}, {"cutoff", fc}, {"Q", Q}}}}});
+    expect("bandpass", gain(bq, fc, rate), 1.0, 1e-3);
+    // band edges: |cos w - cos w0| = alpha sin w, i.e. cos(w -+ phi) =
+    // cos w0 cos phi with tan phi = alpha
+    const double phi = atan(alpha);
+    for (double sign : {-1.0, 1.0}) {
+      double w = acos(cos(w0) * cos(phi)) + sign * phi;
+      expect("bandpass", gain(bq, w * rate / (2 * M_PI), rate), m3db, 1e-3);
+    }
+  }
+  {
+    BiquadCascade<sample2> bq(json{
+        {"sample_rate", rate},
+        {"filters", {{{"type", "dcblock"}, {"cutoff", 2.0}}}}});
+    expect("dcblock", gain(bq, 2.0, rate), m3db, 0.01);
+    batch2 b = make_batch(5000, rate, [](double t) { return 3.0 + sin(2 * M_PI * 50 * t); });
+    bq.reset();
+    bq.process(b);
+    double mean = 0;
+    for (size_t i = 4000; i < 5000; i++) mean += b[i].data[0] / 1000;
+    expect("dcblock at DC", mean, 0.0, 1e-3);
+  }
+
+  // the same output from one batch or from odd-sized pieces, and for the
+  // negated second channel
+  json settings = {{"sample_rate", rate},
+                   {"filters", {{{"type", "dcblock"}},
+                                {{"type", "lowpass"}, {"cutoff", 50.0}, {"order", 4}}}}};
+  auto signal = [](double t) { return 1 + sin(2 * M_PI * 30 * t) + sin(2 * M_PI * 170 * t); };
+  BiquadCascade<sample2> whole(settings), split(settings);
+  batch2 ref = make_batch(1000, rate, signal);
+  whole.process(ref);
+  bool same = true;
+  for (size_t first = 0, k = 0; first < 1000; k++) {
+    size_t n = min<size_t>(7 + 13 * (k % 5), 1000 - first);
+    batch2 b = make_batch(n, rate, signal, first);
+    split.process(b);
+    for (size_t i = 0; i < n; i++)
+      same = same && b[i].data == ref[first + i].data &&
+             b[i].data[1] == -b[i].data[0];
+    first += n;
+  }
+  if (!same) {
+    cout << "Biquad: split batches differ" << endl;
+    ok = false;
+  }
+
+  for (json f : {json{{"type", "lowpass"}, {"order", 3}},
+                 json{{"type", "highpass"}, {"order", 1}},
+                 json{{"type", "lowpass"}, {"cutoff", 500.0}},
+                 json{{"type", "bandpass"}, {"cutoff", 600.0}},
+                 json{{"type", "dcblock"}, {"cutoff", 0.0}}}) {
+    try {
+      BiquadCascade<sample2> bq(json{{"sample_rate", rate}, {"filters", {f}}});
+      cout << "Biquad: accepted " << f << endl;
+      ok = false;
+    } catch (invalid_argument &) {
+    }
+  }
+  return ok;
+}
+
+// Decimation by 4 at 1 kHz: unity gain in the passband, rejection of the
+// tones above the new Nyquist frequency (125 Hz) that would alias into it,
+// seamless batch edges, timestamps on the center sample of the filter
+static bool check_decimator() {
+  bool ok = true;
+  const double rate = 1000.0;
+  Decimator<sample2> dec(json{{"decimation", 4}});
+  const size_t skip = dec.taps() / 4 + 1; // outputs of the first batch
+  for (double f : {5.0, 10.0, 20.0, 30.0}) {
+    dec.reset();
+    double a = amplitude(dec.process(make_batch(4000, rate, [f](double t) {
+                           return sin(2 * M_PI * f * t);
+                         })), skip);
+    if (abs(a - 1) > 0.005) {
+      cout << "Decimator: gain " << a << " at " << f << " Hz" << endl;
+      ok = false;
+    }
+  }
+  for (double f : {200.0, 250.0, 300.0, 450.0}) {
+    dec.reset();
+    double a = amplitude(dec.process(make_batch(4000, rate, [f](double t) {
+                           return sin(2 * M_PI * f * t);
+                         })), skip);
+    if (a > 1e-3) {
+      cout << "Decimator: gain " << a << " at " << f << " Hz" << endl;
+      ok = false;
+    }
+  }
+
+  // the same signal in one batch or in odd-sized pieces
+  auto signal = [](double t) { return sin(2 * M_PI * 30 * t) + 0.1 * t; };
+  Decimator<sample2> whole(json{{"decimation", 4}}), split(json{{"decimation", 4}});
+  batch2 ref = whole.process(make_batch(1000, rate, signal)), got;
+  for (size_t first = 0, k = 0; first < 1000; k++) {
+    size_t n = min<size_t>(7 + 13 * (k % 5), 1000 - first);
+    batch2 out = split.process(make_batch(n, rate, signal, first));
+    got.insert(got.end(), out.begin(), out.end());
+    first += n;
+  }
+  bool same = got.size() == ref.size();
+  for (size_t i = 0; same && i < ref.size(); i++)
+    same = got[i].time == ref[i].time && got[i].data == ref[i].data;
+  if (!same) {
+    cout << "Decimator: split batches differ (" << got.size() << " vs "
+         << ref.size() << " samples)" << endl;
+    ok = false;
+  }
+
+  // a linear-phase filter with unity DC gain passes a ramp unchanged, with
+  // the delay of the center sample: output value (the input sample index)
+  // and timestamp must match
+  dec.reset();
+  batch2 ramp = dec.process(make_batch(200, rate, [rate](double t) {
+    return t * rate;
+  }));
+  double max_err = 0;
+  for (size_t i = 0; i < ramp.size(); i++) {
+    max_err = max(max_err, abs(ramp[i].data[0] - ramp[i].time_since({}) * rate));
+    if (i > 0)
+      max_err = max(max_err, abs(ramp[i].time_since(ramp[i - 1].time) * rate - 4));
+  }
+  if (ramp.empty() || max_err > 1e-6) {
+    cout << "Decimator: timestamps off the center sample by " << max_err
+         << endl;
+    ok = false;
+  }
+  return ok;
+}
+
+// Batch of n samples at 1 kHz from sample index first on, with f(i) on
+// channel 0 and the sample index on channel 1
+static batch2 indexed_batch(size_t n, function<double(size_t)> f, size_t first = 0) {
+  batch2 b = make_batch(n, 1000.0, [](double) { return 0.0; }, first);
+  for (size_t i = 0; i < n; i++) b[i].data = {f(first + i), double(first + i)};
+  return b;
+}
+
+// Sample indices of a capture
+static vector<size_t> indices(TriggerCapture<sample2>::Event const &ev) {
+  vector<size_t> r;
+  for (auto const &s : ev.samples) r.push_back((size_t)s.data[1]);
+  return r;
+}
+
+// Level trigger: shorter pre-trigger for a trigger early in the stream,
+// captures spanning batches, edge modes, hold-off and rate limit
+static bool check_trigger() {
+  bool ok = true;
+  auto fail = [&](string const &what) {
+    cout << "Trigger: " << what << endl;
+    ok = false;
+  };
+  auto range = [](size_t from, size_t to) {
+    vector<size_t> r;
+    for (size_t i = from; i < to; i++) r.push_back(i);
+    return r;
+  };
+  auto step = [](size_t at) { return [at](size_t i) { return i >= at ? 2.0 : 0.0; }; };
+
+  {
+    // trigger on sample 3, with 3 of the 10 pre-trigger samples available
+    TriggerCapture<sample2> trig(json{{"pre_trigger", 10}, {"post_trigger", 5}});
+    auto ev = trig.process(indexed_batch(50, step(3)));
+    if (ev.size() != 1 || ev[0].pre != 3 || indices(ev[0]) != range(0, 8) ||
+        ev[0].time != indexed_batch(1, step(0), 3)[0].time)
+      fail("early trigger");
+  }
+  {
+    // trigger on sample 50, completed in the next batch
+    TriggerCapture<sample2> trig(json{{"pre_trigger", 10}, {"post_trigger", 20}});
+    auto ev1 = trig.process(indexed_batch(60, step(50)));
+    auto ev2 = trig.process(indexed_batch(60, step(50), 60));
+    if (!ev1.empty() || ev2.size() != 1 || ev2[0].pre != 10 ||
+        indices(ev2[0]) != range(40, 70))
+      fail("capture across batches");
+  }
+
+  // 10 Hz sine of amplitude 2 against level 1: 10 rising and 10 falling
+  // crossings in 1 s
+  auto sine = [](size_t i) { return 2 * sin(2 * M_PI * 10 * i / 1000.0); };
+  for (string edge : {"rising", "falling", "both"}) {
+    TriggerCapture<sample2> trig(json{{"trigger_edge", edge}, {"pre_trigger", 1},
+                                      {"post_trigger", 1}});
+    auto ev = trig.process(indexed_batch(1000, sine));
+    size_t expected = edge == "both" ? 20 : 10;
+    bool crossings = ev.size() == expected;
+    for (auto const &e : ev) {
+      bool up = e.samples[1].data[0] >= 1.0 && e.samples[0].data[0] < 1.0;
+      bool down = e.samples[1].data[0] < 1.0 && e.samples[0].data[0] >= 1.0;
+      crossings = crossings && e.pre == 1 &&
+                  (edge == "rising" ? up : edge == "falling" ? down : up || down);
+    }
+    if (!crossings) fail(edge + " edge: " + to_string(ev.size()) + " events");
+  }
+
+  // channels beyond the sample, by index or by name
+  for (json settings : {json{{"trigger_channel", 2}},
+                        json{{"trigger_channel", "z"}, {"channels", {"x", "y", "z"}}}}) {
+    try {
+      TriggerCapture<sample2> trig(settings);
+      fail("accepted " + settings.dump());
+    } catch (invalid_argument &) {
+    }
+  }
+  if (TriggerCapture<sample2>(json{{"trigger_channel", "y"}, {"channels", {"x", "y"}}})
+          .channel() != 1)
+    fail("channel by name");
+
+  // a rising edge every 10 ms (samples 5, 15, ...) for 1 s
+  auto pulses = [](size_t i) { return i % 10 >= 5 ? 2.0 : 0.0; };
+  {
+    // 25 ms hold-off: one edge out of 3
+    TriggerCapture<sample2> trig(json{{"pre_trigger", 0}, {"post_trigger", 1},
+                                      {"trigger_holdoff_ms", 25.0}});
+    auto ev = trig.process(indexed_batch(1000, pulses));
+    bool spaced = ev.size() == 34 && trig.events() == 34 && trig.suppressed() == 66;
+    for (size_t i = 0; spaced && i < ev.size(); i++)
+      spaced = indices(ev[i]) == vector<size_t>{5 + 30 * i};
+    if (!spaced)
+      fail("hold-off: " + to_string(trig.events()) + " events, " +
+           to_string(trig.suppressed()) + " suppressed");
+  }
+  {
+    // 10 events/s: a burst of 10, then one every 100 ms
+    TriggerCapture<sample2> trig(json{{"pre_trigger", 0}, {"post_trigger", 1},
+                                      {"max_event_rate", 10.0}});
+    auto ev = trig.process(indexed_batch(1000, pulses));
+    if (ev.size() != trig.events() || trig.events() < 19 || trig.events() > 20 ||
+        trig.events() + trig.suppressed() != 100 || indices(ev[9]) != vector<size_t>{95})
+      fail("rate: " + to_string(trig.events()) + " events, " +
+           to_string(trig.suppressed()) + " suppressed");
+  }
+  return ok;
+}
+
+// Features of a 50 Hz tone of amplitude 2 on an offset of 3 (and its
+// negation): statistics, spectrum peak with automatic FFT size (capped at
+// 2^15), and with zoom (sized to the batch), and ACF period
+static bool check_features() {
+  bool ok = true;
+  auto fail = [&](string const &what) {
+    cout << "Features: " << what << endl;
+    ok = false;
+  };
+  auto tone = [](double t) { return 3 + 2 * sin(2 * M_PI * 50 * t); };
+  auto near = [](json const &v, double x, double tol) {
+    return v.is_number() && abs(v.get<double>() - x) <= tol;
+  };
+  // peak frequency of a channel, if exactly one peak
+  auto peak = [](json const &f) {
+    return f["peaks"].size() == 1 ? f["peaks"][0][0].get<double>() : -1.0;
+  };
+
+  // 50 periods: exact statistics
+  batch2 b = make_batch(1000, 1000.0, tone);
+  FeatureExtractor fx(json{{"channels", {"x", "y"}}, {"sample_rate", 1000.0}}, b.size());
+  json out = fx.process(b);
+  for (auto [name, sign] : {pair<string, double>{"x", 1.0}, {"y", -1.0}}) {
+    json const &f = out[name];
+    if (!near(f["mean"], 3 * sign, 1e-9) || !near(f["stdev"], sqrt(2.0), 1e-9) ||
+        !near(f["rms"], sqrt(11.0), 1e-9) || !near(f["min"], sign > 0 ? 1 : -5, 1e-9) ||
+        !near(f["max"], sign > 0 ? 5 : -1, 1e-9) || !near(f["peak_to_peak"], 4, 1e-9) ||
+        !near(f["crest_factor"], 5 / sqrt(11.0), 1e-9) || !near(f["skewness"], 0, 1e-9) ||
+        !near(f["kurtosis"], 1.5, 1e-9))
+      fail("statistics of " + name + ": " + f.dump());
+    if (abs(peak(f) - 50) > 0.01) fail("peak of " + name + ": " + f["peaks"].dump());
+    if (!near(f["acf"]["period"], 0.02, 1e-9) || !near(f["acf"]["periodicity"], 1, 0.05))
+      fail("acf of " + name + ": " + f["acf"].dump());
+  }
+
+  // automatic size capped at 2^15 on a longer batch; an explicit size
+  // longer than the batch gives no peaks
+  batch2 lb = make_batch(70000, 1000.0, tone);
+  FeatureExtractor capped(json{{"features", {"peaks"}}}, lb.size());
+  if (abs(peak(capped.process(lb)["ch0"]) - 50) > 1e-3) fail("peak with 2^15 points");
+  FeatureExtractor too_long(json{{"features", {"peaks"}}, {"fft_power", 11}}, b.size());
+  if (!too_long.process(b)["ch0"]["peaks"].empty()) fail("peaks from a short batch");
+
+  // zoom by 50 (20 Hz band): the FFT size is the largest whose 50-fold
+  // input fits the batch, 2^7 for 8000 samples (0.16 Hz bins)
+  json zoom = {{"features", {"peaks"}}, {"sample_rate", 1000.0},
+               {"fft_zoom_center", 52.0}, {"fft_zoom_bandwidth", 20.0}};
+  batch2 zb = make_batch(8000, 1000.0, tone);
+  FeatureExtractor zoomed(zoom, zb.size());
+  if (abs(peak(zoomed.process(zb)["ch0"]) - 50) > 0.01) fail("zoomed peak");
+
+  for (int power : {-1, 16}) {
+    try {
+      FeatureExtractor bad(json{{"fft_power", power}}, 1000);
+      fail("accepted fft_power " + to_string(power));
+    } catch (invalid_argument &) {
+    }
+  }
+  return ok;
+}
+
+// Samples at the given times (ms), with values f(t) and -f(t)
+static batch2 timed_batch(vector<double> const &ms, function<double(double)> f) {
+  batch2 b(ms.size());
+  for (size_t i = 0; i < ms.size(); i++) {
+    b[i].time = time_point<system_clock, nanoseconds>{} +
+                nanoseconds((int64_t)llround(ms[i] * 1e6));
+    b[i].data = {f(ms[i]), -f(ms[i])};
+  }
+  return b;
+}
+
+// Fan-in of two devices: nearest sample within the tolerance (NaN beyond),
+// linear interpolation on a common grid, release of a stalled device after
+// merge_max_lag_ms, and each output time produced exactly once when merging
+// as data come in
+static bool check_merger() {
+  bool ok = true;
+  using merger = FanInMerger<sample2>;
+  auto fail = [&](string const &what) {
+    cout << "Merger: " << what << endl;
+    ok = false;
+  };
+  auto ms = [](merger::sample const &m) { return m.time_since({}) * 1000; };
+  auto same = [](double a, double b) { return (isnan(a) && isnan(b)) || abs(a - b) < 1e-9; };
+  auto grid = [](double from, double step, size_t n) {
+    vector<double> r;
+    for (size_t i = 0; i < n; i++) r.push_back(from + i * step);
+    return r;
+  };
+
+  {
+    // reference every 10 ms, other device at irregular times: nearest one
+    // within 3 ms, NaN at 20 ms (12 and 33 are too far)
+    merger m(json{{"merge_tolerance_ms", 3.0}}, 2);
+    m.add(0, timed_batch(grid(0, 10, 5), [](double t) { return t; }));
+    m.add(1, timed_batch({1, 12, 33, 41}, [](double t) { return 100 + t; }));
+    auto out = m.merge();
+    const double nan = numeric_limits<double>::quiet_NaN();
+    vector<double> expected = {101, 112, nan, 133, 141};
+    bool good = out.size() == 5 && m.channels() == 4;
+    for (size_t i = 0; good && i < out.size(); i++)
+      good = ms(out[i]) == 10.0 * i && out[i].data.size() == 4 &&
+             out[i].data[0] == 10.0 * i && out[i].data[1] == -10.0 * i &&
+             same(out[i].data[2], expected[i]) && same(out[i].data[3], -expected[i]);
+    if (!good) fail("nearest sample with tolerance");
+  }
+  {
+    // 250 Hz grid from devices at 1 kHz and 333 Hz: linear signals are
+    // interpolated exactly
+    merger m(json{{"merge_rate", 250.0}}, 2);
+    m.add(0, timed_batch(grid(0, 1, 101), [](double t) { return t; }));
+    m.add(1, timed_batch(grid(0, 3, 34), [](double t) { return 2 * t + 1; }));
+    auto out = m.merge();
+    bool good = out.size() == 25;
+    for (size_t i = 0; good && i < out.size(); i++) {
+      double t = 4.0 * i;
+      good = same(ms(out[i]), t) && same(out[i].data[0], t) &&
+             same(out[i].data[2], 2 * t + 1) && same(out[i].data[3], -(2 * t + 1));
+    }
+    if (!good) fail("interpolation on the merge_rate grid: " + to_string(out.size()) + " samples");
+  }
+  {
+    // the second device stops at 10 ms: with a 20 ms max lag, the reference
+    // is merged up to 20 ms before its newest sample, with NaN beyond the
+    // tolerance
+    merger m(json{{"merge_max_lag_ms", 20.0}, {"merge_tolerance_ms", 2.0}}, 2);
+    m.add(1, timed_batch(grid(0, 1, 11), [](double t) { return t; }));
+    size_t merged = 0;
+    bool good = true;
+    for (size_t k = 0; k < 10; k++) {
+      m.add(0, timed_batch(grid(10 * k, 1, 10), [](double t) { return t; }));
+      for (auto const &s : m.merge()) {
+        good = good && ms(s) == merged && (merged <= 12 ? s.data[2] == min<double>(merged, 10)
+                                                        : isnan(s.data[2]));
+        merged++;
+      }
+      // up to min(newest reference, 10 ms), or newest reference - 20 ms
+      good = good && merged == (k == 0 ? 10 : max<size_t>(11, 10 * k - 10));
+    }
+    if (!good) fail("stalled device: " + to_string(merged) + " samples merged");
+  }
+  for (double rate : {0.0, 500.0}) {
+    // devices at 1 kHz and 700 Hz added in pieces of different size, and
+    // merged after each: the same output as merging everything at once
+    json settings = {{"merge_rate", rate}};
+    merger whole(settings, 2), pieces(settings, 2);
+    auto f = [](double t) { return sin(t / 10); };
+    batch2 a = timed_batch(grid(0, 1, 300), f), b = timed_batch(grid(0.5, 1 / 0.7, 210), f);
+    whole.add(0, a);
+    whole.add(1, b);
+    auto ref = whole.merge();
+    vector<merger::sample> got;
+    for (size_t i = 0, j = 0, k = 0; i < a.size() || j < b.size(); k++) {
+      size_t na = min<size_t>(5 + 7 * (k % 4), a.size() - i);
+      size_t nb = min<size_t>(3 + 11 * (k % 3), b.size() - j);
+      pieces.add(0, batch2(a.begin() + i, a.begin() + i + na));
+      pieces.add(1, batch2(b.begin() + j, b.begin() + j + nb));
+      i += na;
+      j += nb;
+      auto out = pieces.merge();
+      got.insert(got.end(), out.begin(), out.end());
+    }
+    bool good = got.size() == ref.size();
+    for (size_t i = 0; good && i < ref.size(); i++) {
+      good = got[i].time == ref[i].time;
+      for (size_t c = 0; good && c < 4; c++) good = same(got[i].data[c], ref[i].data[c]);
+    }
+    if (!good)
+      fail("incremental merge at " + to_string(rate) + " Hz: " + to_string(got.size()) +
+           " samples vs " + to_string(ref.size()));
+  }
+  return ok;
+}
+
+// Conversion of raw int16_t samples to engineering units: one gain/offset
+// for all channels or one per channel (unscaled beyond the list), identity
+// short-circuit, and the raw and scaled JSON output
+static bool check_scaling() {
+  bool ok = true;
+  auto fail = [&](string const &what) {
+    cout << "Scaling: " << what << endl;
+    ok = false;
+  };
+  using raw3 = Acquisitor<array<int16_t, 3>>::sample;
+  using eng3 = Acquisitor<array<double, 3>>::sample;
+  const auto t0 = time_point<system_clock, nanoseconds>{};
+  vector<raw3> raw = {{t0 + milliseconds(1), {100, -200, 32767}},
+                      {t0 + milliseconds(2), {-32768, 0, 1}}};
+  // raw converted with k and o, in a new batch and in place on doubles
+  auto expect = [&](char const *what, Scaling &sc, array<double, 3> k, array<double, 3> o) {
+    vector<eng3> eng, in_place(raw.size());
+    sc.apply(raw, eng);
+    for (size_t i = 0; i < raw.size(); i++) {
+      in_place[i].time = raw[i].time;
+      for (size_t c = 0; c < 3; c++) in_place[i].data[c] = raw[i].data[c];
+    }
+    sc.apply(in_place);
+    bool good = eng.size() == raw.size();
+    for (size_t i = 0; good && i < raw.size(); i++) {
+      good = eng[i].time == raw[i].time && in_place[i].data == eng[i].data;
+      for (size_t c = 0; c < 3; c++)
+        good = good && eng[i].data[c] == raw[i].data[c] * k[c] + o[c];
+    }
+    if (!good) fail(what);
+  };
+
+  Scaling scalar(json{{"scale", 0.5}, {"offset", 1.0}});
+  expect("scalar gain and offset", scalar, {0.5, 0.5, 0.5}, {1, 1, 1});
+  Scaling lists(json{{"scale", {2.0, 0.1}}, {"offset", {0.0, 0.0, 5.0}}});
+  expect("per-channel gains and offsets", lists, {2, 0.1, 1}, {0, 0, 5});
+  Scaling single(json{{"scale", {3.0}}});
+  expect("single-element list", single, {3, 3, 3}, {0, 0, 0});
+  Scaling none(json::object());
+  expect("identity", none, {1, 1, 1}, {0, 0, 0});
+  if (!none.identity() || !Scaling(json{{"scale", {1.0, 1.0}}, {"offset", 0}}).identity() ||
+      scalar.identity() || lists.identity() || Scaling(json{{"offset", {0.0, 1e-3}}}).identity())
+    fail("identity()");
+  try {
+    Scaling bad(json{{"scale", "x"}});
+    fail("accepted a string scale");
+  } catch (invalid_argument &) {
+  }
+
+  // units = "raw" publishes the integer counts, otherwise the scaled values
+  json raw_rows = json::array(), eng_rows = json::array();
+  vector<eng3> eng;
+  scalar.apply(raw, eng);
+  package_raw(raw, t0, raw_rows);
+  package_raw(eng, t0, eng_rows);
+  if (raw_rows != json{{0.001, 100, -200, 32767}, {0.002, -32768, 0, 1}} ||
+      !raw_rows[0][1].is_number_integer() ||
+      eng_rows != json{{0.001, 51.0, -99.0, 16384.5}, {0.002, -16383.0, 1.0, 1.5}} ||
+      !eng_rows[0][1].is_number_float())
+    fail("JSON output: " + raw_rows.dump() + ", " + eng_rows.dump());
+  return ok;
+}
+
+// Flight recorder on a small ring, with batches of varying size across
+// several wraps: after each write, the recording must hold the newest batches
+// whose records have not been overwritten (nor dropped on a wrap, nor pushed
+// out of the index), intact
+static bool check_recorder() {
+  using namespace recorder;
+  bool ok = true;
+  const char *path = "pipeline_test.rec";
+  const size_t index_capacity = 6;
+  const size_t data_offset = HEADER_SIZE + align8(index_capacity * sizeof(IndexEntry));
+  const size_t data_size = 4000, sizes[] = {30, 60, 5, 30, 5, 70, 1, 45};
+  remove(path);
+  FlightRecorder<sample2> rec(path, data_offset + data_size, index_capacity);
+  // expected records: seq, offset, batch
+  struct Record {
+    uint64_t seq;
+    size_t offset, bytes;
+    batch2 batch;
+  };
+  deque<Record> alive;
+  size_t pos = 0, first = 0;
+  for (uint64_t seq = 1; seq <= 100 && ok; seq++) {
+    batch2 b = indexed_batch(sizes[seq % 8], [seq](size_t i) { return seq * 1000.0 + i; }, first);
+    first += b.size();
+    rec.write(b);
+    size_t bytes = record_bytes(b.size(), 2, sizeof(double));
+    if (pos + bytes > data_size) {
+      while (!alive.empty() && alive.front().offset >= pos) alive.pop_front();
+      pos = 0;
+    }
+    while (!alive.empty() && alive.front().offset < pos + bytes &&
+           alive.front().offset + alive.front().bytes > pos)
+      alive.pop_front();
+    if (alive.size() == index_capacity) alive.pop_front();
+    alive.push_back({seq, pos, bytes, b});
+    pos += bytes;
+
+    FlightRecording r(path);
+    MappedFile f(path, 0, false);
+    Slot const *slot = current((FileHeader const *)f.data());
+    bool same = r.index().size() == alive.size() && slot && slot->seq == seq &&
+                slot->oldest == alive.front().seq && slot->write_pos == pos;
+    for (size_t i = 0; same && i < alive.size(); i++) {
+      auto const &e = r.index()[i];
+      auto const &a = alive[i];
+      auto rb = r.batch(i);
+      same = e.seq == a.seq && e.offset == a.offset && rb.n == a.batch.size();
+      for (size_t j = 0; same && j < rb.n; j++) {
+        for (size_t c = 0; c < 2; c++)
+          same = same && ((double const *)(rb.columns + c * rb.stride))[j] ==
+                             a.batch[j].data[c];
+        same = same && rb.time[j] == a.batch[j].time.time_since_epoch().count();
+      }
+    }
+    if (!same) {
+      cout << "Recorder: after batch " << seq << ", " << r.index().size()
+           << " batches from " << (r.index().empty() ? 0 : r.index()[0].seq)
+           << ", expected " << alive.size() << " from " << alive.front().seq
+           << endl;
+      ok = false;
+    }
+  }
+  remove(path);
+  return ok;
+}
+
+// Replay of a flight recording and of a CSV file, as fast as possible:
+// values and sample spacing as recorded, a partial last batch and then
+// exhausted(), or with replay_loop the next loop following on one sample
+// period after the last sample
+static bool check_replay() {
+  bool ok = true;
+  using replay = ReplayAcquisitor<array<double, 2>>;
+  // batches of the replay of file, with the given capacity, in at most max
+  // batches
+  auto batches = [](json settings, size_t max) {
+    replay acq(settings);
+    vector<batch2> r;
+    while (r.size() < max && !acq.exhausted()) {
+      acq.fill_buffer();
+      if (!acq.data().empty()) r.push_back(acq.data());
+    }
+    return make_pair(r, acq.exhausted());
+  };
+  // whether the samples of the batches have values f(k) for k = 0, 1, ...
+  // and are spaced by period ms
+  auto check = [&](char const *what, vector<batch2> const &r,
+                   function<array<double, 2>(size_t)> f, double period) {
+    size_t k = 0;
+    bool good = true;
+    for (auto const &b : r)
+      for (auto const &smp : b) {
+        good = good && smp.data == f(k);
+        if (k > 0)
+          good = good && abs(smp.time_since(r[0][0].time) - k * period / 1000) < 1e-8;
+        k++;
+      }
+    if (!good) {
+      cout << "Replay " << what << ": wrong values or timestamps" << endl;
+      ok = false;
+    }
+  };
+  auto sizes = [](vector<batch2> const &r) {
+    vector<size_t> n;
+    for (auto const &b : r) n.push_back(b.size());
+    return n;
+  };
+
+  {
+    // 11 samples at 1 kHz, in recorded batches of 4, 5 and 2
+    const char *path = "pipeline_test.rec";
+    remove(path);
+    {
+      FlightRecorder<sample2> rec(path, 64 * 1024, 16);
+      auto value = [](size_t i) { return 0.5 * i; };
+      rec.write(indexed_batch(4, value, 0));
+      rec.write(indexed_batch(5, value, 4));
+      rec.write(indexed_batch(2, value, 9));
+    }
+    auto [r, exhausted] = batches(json{{"replay_file", path}, {"replay_speed", 0.0},
+                                       {"capacity", 4}}, 10);
+    if (sizes(r) != vector<size_t>{4, 4, 3} || !exhausted) {
+      cout << "Replay of a recording: " << r.size() << " batches" << endl;
+      ok = false;
+    }
+    check("of a recording", r, [](size_t k) { return array<double, 2>{0.5 * k, double(k)}; }, 1.0);
+    remove(path);
+  }
+  {
+    // 7 samples every 2 ms, with a header
+    const char *path = "pipeline_test.csv";
+    {
+      ofstream csv(path);
+      csv << "time,x,y\n";
+      for (size_t i = 0; i < 7; i++) csv << 10 + 0.002 * i << "," << i << ";" << -2.0 * i << "\n";
+    }
+    auto value = [](size_t k) { return array<double, 2>{double(k % 7), -2.0 * (k % 7)}; };
+    json settings = {{"replay_file", path}, {"replay_speed", 0.0}, {"capacity", 3}};
+    auto [r, exhausted] = batches(settings, 10);
+    if (sizes(r) != vector<size_t>{3, 3, 1} || !exhausted) {
+      cout << "Replay of a CSV file: " << r.size() << " batches" << endl;
+      ok = false;
+    }
+    check("of a CSV file", r, value, 2.0);
+    settings["replay_loop"] = true;
+    auto [looped, stopped] = batches(settings, 8);
+    if (sizes(looped) != vector<size_t>(8, 3) || stopped) {
+      cout << "Looped replay: " << looped.size() << " batches" << endl;
+      ok = false;
+    }
+    check("in a loop", looped, value, 2.0);
+    remove(path);
+  }
+  {
+    // into int16_t samples: rounded, and clamped to the range
+    const char *rec_path = "pipeline_test.rec", *csv_path = "pipeline_test.csv";
+    remove(rec_path);
+    {
+      FlightRecorder<sample2> rec(rec_path, 64 * 1024, 16);
+      rec.write(timed_batch({0, 1, 2}, [](double t) { return t == 0 ? 1.4 : t == 1 ? -2.5 : 7e4; }));
+      ofstream csv(csv_path);
+      csv << "0,1.6,-1.6\n0.001,40000,-40000\n";
+    }
+    using replay16 = ReplayAcquisitor<array<int16_t, 2>>;
+    replay16 from_rec(json{{"replay_file", rec_path}, {"replay_speed", 0.0}, {"capacity", 3}});
+    replay16 from_csv(json{{"replay_file", csv_path}, {"replay_speed", 0.0}, {"capacity", 2}});
+    from_rec.fill_buffer();
+    from_csv.fill_buffer();
+    vector<array<int16_t, 2>> got, expected = {{1, -1}, {-3, 3}, {32767, -32768},
+                                               {2, -2}, {32767, -32768}};
+    for (auto const &smp : from_rec.data()) got.push_back(smp.data);
+    for (auto const &smp : from_csv.data()) got.push_back(smp.data);
+    if (got != expected) {
+      cout << "Replay: wrong conversion to int16_t" << endl;
+      ok = false;
+    }
+    remove(rec_path);
+    remove(csv_path);
+  }
+  {
+    // stop() during a one-hour gap of a replay in real time
+    const char *path = "pipeline_test.csv";
+    {
+      ofstream csv(path);
+      csv << "0,1,2\n3600,3,4\n";
+    }
+    replay acq(json{{"replay_file", path}, {"capacity", 1}});
+    BatchQueue<replay::batch> q(2);
+    acq.start(q);
+    replay::batch b;
+    q.pop(b);
+    this_thread::sleep_for(milliseconds(20));
+    auto t0 = steady_clock::now();
+    acq.stop();
+    double wait = duration<double>(steady_clock::now() - t0).count();
+    if (b.size() != 1 || wait > 0.5) {
+      cout << "Replay: stop() took " << wait << " s" << endl;
+      ok = false;
+    }
+    remove(path);
+  }
+  return ok;
+}
+
+// Adaptive capacity on a consumer with busy time a + b n (plus 5% noise) for
+// batches of n samples at 1 kHz: convergence to the latency target, or to
+// the smallest capacity the consumer keeps up with, within the bounds
+static bool check_capacity_controller() {
+  bool ok = true;
+  mt19937 gen(3);
+  uniform_real_distribution<double> noise(0.95, 1.05);
+  const double T = 1e-3;
+  struct Case {
+    size_t capacity;
+    double target_ms, a, b;
+    size_t expected;
+  };
+  for (Case c : {Case{1000, 100.0, 2e-3, 1e-5, 100},   // latency target
+                 Case{20, 100.0, 2e-3, 1e-5, 100},
+                 Case{20, 10.0, 50e-3, 1e-4, 72},      // keep up: a / (0.8 T - b)
+                 Case{1000, 10.0, 50e-3, 1e-4, 72},
+                 Case{100, 1.0, 0.0, 0.0, 50},         // clamped to min
+                 Case{100, 10000.0, 2e-3, 1e-5, 5000}, // clamped to max
+                 Case{100, 100.0, 1e-3, 1e-3, 5000}}) { // never keeps up
+    CapacityController ctl(json{{"capacity", c.capacity},
+                                {"min_capacity", 50},
+                                {"max_capacity", 5000},
+                                {"target_latency_ms", c.target_ms},
+                                {"headroom", 0.8}});
+    size_t n = ctl.capacity();
+    for (int i = 0; i < 50; i++)
+      n = ctl.update(n, (n - 1) * T, (c.a + c.b * n) * noise(gen));
+    // deadband: changes below 10% are ignored, except to keep up
+    if (n < c.expected || n > c.expected * 1.1) {
+      cout << "Capacity controller: " << n << " from " << c.capacity
+           << ", expected " << c.expected << endl;
+      ok = false;
+    }
+    if (abs(ctl.period() - T) > 1e-9) {
+      cout << "Capacity controller: period " << ctl.period() << endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+#ifdef BUFFERED_TIMING
+// Latency histogram: values below 16 ns exact, then 16 buckets per power of
+// two, each reported at its midpoint (relative error up to 1/32); percentiles
+// of known distributions
+static bool check_latency_histogram() {
+  bool ok = true;
+  static LatencyHistogram h;
+  // reported value of the bucket holding v: alone below a far larger value,
+  // so that the percentile is not clamped to the maximum
+  auto reported = [](uint64_t v) {
+    h.reset();
+    h.record_ns(v);
+    h.record_ns(1ull << 62);
+    return h.percentile(50);
+  };
+  for (uint64_t v = 0; v < 16; v++) ok = ok && reported(v) == v;
+  for (unsigned shift = 0; shift < 40; shift++) {
+    for (uint64_t sub = 16; sub < 32; sub++) {
+      uint64_t lo = sub << shift, hi = ((sub + 1) << shift) - 1;
+      double mid = lo + (1ull << shift) / 2.0;
+      if (reported(lo) != mid || reported(hi) != mid ||
+          reported(hi + 1) == mid) {
+        cout << "Histogram: bucket [" << lo << ", " << hi << "] reported as "
+             << reported(lo) << ", " << reported(hi) << endl;
+        ok = false;
+      }
+    }
+  }
+  mt19937_64 gen(7);
+  double max_rel = 0;
+  for (int i = 0; i < 100000; i++) {
+    uint64_t v = 16 + gen() % (1ull << (4 + gen() % 36));
+    max_rel = max(max_rel, abs(reported(v) - v) / v);
+  }
+  if (max_rel > 1.0 / 32) {
+    cout << "Histogram: relative error " << max_rel << endl;
+    ok = false;
+  }
+
+  // exponential latencies, mean 1 ms: p-th percentile at -ln(1 - p) ms
+  h.reset();
+  exponential_distribution<double> latency(1e-6);
+  double sum = 0;
+  uint64_t vmax = 0;
+  for (int i = 0; i < 1000000; i++) {
+    uint64_t v = (uint64_t)latency(gen);
+    h.record(nanoseconds(v));
+    sum += v;
+    vmax = max(vmax, v);
+  }
+  for (double p : {50.0, 90.0, 99.0, 99.9}) {
+    double expected = -log(1 - p / 100) * 1e6;
+    if (abs(h.percentile(p) - expected) / expected > 0.04) {
+      cout << "Histogram: p" << p << " " << h.percentile(p) << " ns, expected "
+           << expected << endl;
+      ok = false;
+    }
+  }
+  if (h.count() != 1000000 || abs(h.mean() - sum / 1000000) > 1e-3 ||
+      h.max() != vmax || abs(h.percentile(100) - vmax) / vmax > 1.0 / 32) {
+    cout << "Histogram: count " << h.count() << ", mean " << h.mean()
+         << ", max " << h.max() << endl;
+    ok = false;
+  }
+  return ok;
+}
+#endif
+
+int main() {
+  bool ok = true;
+  bool ok_queue = check_batch_queue();
+  cout << "Batch queue: " << (ok_queue ? "OK" : "FAILED") << endl;
+  ok = ok && ok_queue;
+  bool ok_latency = check_batch_latency();
+  cout << "Batch latency: " << (ok_latency ? "OK" : "FAILED") << endl;
+  ok = ok && ok_latency;
+  bool ok_biquad = check_biquad();
+  cout << "Biquad: " << (ok_biquad ? "OK" : "FAILED") << endl;
+  ok = ok && ok_biquad;
+  bool ok_dec = check_decimator();
+  cout << "Decimator: " << (ok_dec ? "OK" : "FAILED") << endl;
+  ok = ok && ok_dec;
+  bool ok_feat = check_features();
+  cout << "Features: " << (ok_feat ? "OK" : "FAILED") << endl;
+  ok = ok && ok_feat;
+  bool ok_merge = check_merger();
+  cout << "Merger: " << (ok_merge ? "OK" : "FAILED") << endl;
+  ok = ok && ok_merge;
+  bool ok_scaling = check_scaling();
+  cout << "Scaling: " << (ok_scaling ? "OK" : "FAILED") << endl;
+  ok = ok && ok_scaling;
+  bool ok_rec = check_recorder();
+  cout << "Recorder: " << (ok_rec ? "OK" : "FAILED") << endl;
+  ok = ok && ok_rec;
+  bool ok_replay = check_replay();
+  cout << "Replay: " << (ok_replay ? "OK" : "FAILED") << endl;
+  ok = ok && ok_replay;
+  bool ok_trig = check_trigger();
+  cout << "Trigger: " << (ok_trig ? "OK" : "FAILED") << endl;
+  ok = ok && ok_trig;
+  bool ok_capa = check_capacity_controller();
+  cout << "Capacity controller: " << (ok_capa ? "OK" : "FAILED") << endl;
+  ok = ok && ok_capa;
+#ifdef BUFFERED_TIMING
+  bool ok_hist = check_latency_histogram();
+  cout << "Latency histogram: " << (ok_hist ? "OK" : "FAILED") << endl;
+  ok = ok && ok_hist;
+#endif
+
+  return ok ? 0 : 1;
+}
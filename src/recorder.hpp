@@ -0,0 +1,375 @@
+/*
+  ____                        _
+ |  _ \ ___  ___ ___  _ __ __| | ___ _ __
+ | |_) / _ \/ __/ _ \| '__/ _` |/ _ \ '__|
+ |  _ <  __/ (_| (_) | | | (_| |  __/ |
+ |_| \_\___|\___\___/|_|  \__,_|\___|_|
+
+Flight recorder: raw batches at full rate into a preallocated, memory-mapped
+circular file of fixed size, so that the raw signal is still available after
+an incident even if only features or decimated data were published.
+File layout:
+  header (4 KiB) | index (index_capacity entries) | data ring
+Each batch record is columnar: a BatchHeader, the timestamps (int64 ns since
+the epoch), then one column per channel in the native scalar type. Batches
+are written straight from the batch buffers into the mapping, then committed
+in order: record, index entry, header slot. The header keeps two checksummed
+commit slots, written alternately, so that a process killed at any point
+leaves a consistent file (the last complete commit wins); records about to
+be overwritten are invalidated first. An existing compatible file is resumed.
+Configured by the plugin settings:
+  recorder_file    = "flight.rec" # empty (default): no recording
+  recorder_size_mb = 64           # whole file size
+  recorder_index   = 4096         # index entries (most recent batches)
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace recorder {
+
+constexpr char MAGIC[8] = {'M', 'A', 'D', 'S', 'R', 'E', 'C', '1'};
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t BATCH_MAGIC = 0x48435442; // "BTCH"
+constexpr size_t HEADER_SIZE = 4096;
+
+// Committed state; two of them, written alternately
+struct Slot {
+  uint64_t seq;       // last committed batch (0: none)
+  uint64_t write_pos; // offset of the next record in the data ring
+  uint64_t oldest;    // oldest batch still in the ring
+  uint64_t checksum;
+};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version, channels;
+  uint32_t elem_size;
+  char elem_type; // 'f'loat, 'i'nt, 'u'nsigned
+  char pad[3];
+  uint64_t file_size, index_offset, index_capacity, data_offset, data_size;
+  Slot slots[2];
+};
+
+struct IndexEntry {
+  int64_t t0, t1;  // first and last timestamp (ns since the epoch)
+  uint64_t seq;    // 0: invalid
+  uint64_t offset; // in the data ring
+  uint32_t n, pad;
+};
+
+struct BatchHeader {
+  uint32_t magic, n;
+  uint64_t seq;
+  uint64_t bytes; // whole record
+};
+
+inline uint64_t checksum(Slot const &s) {
+  return (s.seq * 0x9E3779B97F4A7C15ull) ^ (s.write_pos + 0x632BE59BD9B4E019ull) ^
+         (s.oldest * 0xC2B2AE3D27D4EB4Full);
+}
+
+// Most recent valid commit slot of a header, or nullptr
+inline Slot const *current(FileHeader const *h) {
+  Slot const *best = nullptr;
+  for (auto const &s : h->slots)
+    if (s.seq > 0 && s.checksum == checksum(s) && (!best || s.seq > best->seq))
+      best = &s;
+  return best;
+}
+
+inline size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+inline size_t record_bytes(size_t n, size_t channels, size_t elem_size) {
+  return sizeof(BatchHeader) + n * sizeof(int64_t) + channels * align8(n * elem_size);
+}
+
+// Whole-file shared mapping
+class MappedFile {
+public:
+  MappedFile(std::string const &path, size_t size, bool writable) : _size(size) {
+#ifdef _WIN32
+    _file = CreateFileA(path.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+                        FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                        writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) throw std::runtime_error("Cannot open " + path);
+    LARGE_INTEGER fs;
+    GetFileSizeEx(_file, &fs);
+    if (_size == 0) _size = fs.QuadPart;
+    _map = CreateFileMappingA(_file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+                              DWORD(uint64_t(_size) >> 32), DWORD(_size), nullptr);
+    if (!_map) throw std::runtime_error("Cannot map " + path);
+    _data = (uint8_t *)MapViewOfFile(_map, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, _size);
+    if (!_data) throw std::runtime_error("Cannot map " + path);
+#else
+    _fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (_fd < 0) throw std::runtime_error("Cannot open " + path);
+    struct stat st;
+    fstat(_fd, &st);
+    if (_size == 0) _size = st.st_size;
+    if (writable && (size_t)st.st_size != _size) {
+      // preallocate, so that writes never fail for lack of space
+      if (ftruncate(_fd, _size) != 0) throw std::runtime_error("Cannot resize " + path);
+#ifdef __linux__
+      posix_fallocate(_fd, 0, _size);
+#endif
+    }
+    void *p = mmap(nullptr, _size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, _fd, 0);
+    if (p == MAP_FAILED) throw std::runtime_error("Cannot map " + path);
+    _data = (uint8_t *)p;
+#endif
+  }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (_data) UnmapViewOfFile(_data);
+    if (_map) CloseHandle(_map);
+    if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+#else
+    if (_data) munmap(_data, _size);
+    if (_fd >= 0) ::close(_fd);
+#endif
+  }
+
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+
+  uint8_t *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  size_t _size;
+  uint8_t *_data = nullptr;
+#ifdef _WIN32
+  HANDLE _file = INVALID_HANDLE_VALUE, _map = nullptr;
+#else
+  int _fd = -1;
+#endif
+};
+
+template <typename S>
+constexpr char elem_type() {
+  return std::is_floating_point_v<S> ? 'f' : std::is_signed_v<S> ? 'i' : 'u';
+}
+
+} // namespace recorder
+
+
+// Writer. Sample is an Acquisitor<T>::sample, with T a fixed-size array
+template <typename Sample>
+class FlightRecorder {
+public:
+  using data_type = decltype(Sample::data);
+  using scalar = typename data_type::value_type;
+  static constexpr size_t CHANNELS = std::tuple_size_v<data_type>;
+
+  FlightRecorder(std::string const &path, size_t size, size_t index_capacity)
+      : _file(path, size, true) {
+    using namespace recorder;
+    _h = (FileHeader *)_file.data();
+    _index = (IndexEntry *)(_file.data() + HEADER_SIZE);
+    _data = _file.data() + HEADER_SIZE + align8(index_capacity * sizeof(IndexEntry));
+    const size_t data_offset = _data - _file.data();
+    if (data_offset + record_bytes(1, CHANNELS, sizeof(scalar)) > size)
+      throw std::invalid_argument("Flight recorder file too small");
+
+    bool compatible = !memcmp(_h->magic, MAGIC, 8) && _h->version == VERSION &&
+                      _h->channels == CHANNELS && _h->elem_size == sizeof(scalar) &&
+                      _h->elem_type == elem_type<scalar>() && _h->file_size == size &&
+                      _h->index_capacity == index_capacity && _h->data_offset == data_offset;
+    Slot const *s = compatible ? current(_h) : nullptr;
+    if (s) { // resume
+      _seq = s->seq;
+      _pos = s->write_pos;
+      _oldest = s->oldest;
+    } else { // initialize
+      memset(_file.data(), 0, data_offset);
+      memcpy(_h->magic, MAGIC, 8);
+      _h->version = VERSION;
+      _h->channels = CHANNELS;
+      _h->elem_size = sizeof(scalar);
+      _h->elem_type = elem_type<scalar>();
+      _h->file_size = size;
+      _h->index_offset = HEADER_SIZE;
+      _h->index_capacity = index_capacity;
+      _h->data_offset = data_offset;
+      _h->data_size = size - data_offset;
+      _seq = _pos = 0;
+      _oldest = 1;
+    }
+  }
+
+  uint64_t batches() const { return _seq; }
+  size_t skipped() const { return _skipped; }
+
+  // Append a batch (from the consumer thread: it only touches memory)
+  void write(std::vector<Sample> const &batch) {
+    using namespace recorder;
+    const size_t n = batch.size();
+    const size_t bytes = record_bytes(n, CHANNELS, sizeof(scalar));
+    if (n == 0 || bytes > _h->data_size) {
+      _skipped += n > 0;
+      return;
+    }
+    size_t pos = _pos + bytes > _h->data_size ? 0 : _pos;
+    const uint64_t seq = _seq + 1;
+    release(pos, pos + bytes, seq);
+
+    // record body, columnar, straight from the batch
+    uint8_t *rec = _data + pos;
+    int64_t *t = (int64_t *)(rec + sizeof(BatchHeader));
+    for (size_t i = 0; i < n; i++) t[i] = batch[i].time.time_since_epoch().count();
+    uint8_t *col = (uint8_t *)(t + n);
+    for (size_t c = 0; c < CHANNELS; c++) {
+      scalar *v = (scalar *)col;
+      for (size_t i = 0; i < n; i++) v[i] = batch[i].data[c];
+      col += align8(n * sizeof(scalar));
+    }
+    BatchHeader *bh = (BatchHeader *)rec;
+    bh->n = (uint32_t)n;
+    bh->seq = seq;
+    bh->bytes = bytes;
+    std::atomic_thread_fence(std::memory_order_release);
+    bh->magic = BATCH_MAGIC;
+
+    // index entry, then commit
+    IndexEntry &e = _index[seq % _h->index_capacity];
+    e.seq = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    e.t0 = t[0];
+    e.t1 = t[n - 1];
+    e.offset = pos;
+    e.n = (uint32_t)n;
+    std::atomic_thread_fence(std::memory_order_release);
+    e.seq = seq;
+    _seq = seq;
+    _pos = pos + bytes;
+    if (_oldest + _h->index_capacity <= _seq) _oldest = _seq - _h->index_capacity + 1;
+    commit();
+  }
+
+private:
+  recorder::MappedFile _file;
+  recorder::FileHeader *_h;
+  recorder::IndexEntry *_index;
+  uint8_t *_data;
+  uint64_t _seq, _pos, _oldest;
+  size_t _skipped = 0;
+
+  // invalidate the oldest records overlapping [from, to), before writing.
+  // Records follow each other in ring order from the oldest one to _pos; on
+  // a wrap (from < _pos) those between _pos and the end of the ring are the
+  // oldest ones, and are dropped first
+  void release(size_t from, size_t to, uint64_t seq) {
+    using namespace recorder;
+    const size_t size = _h->data_size;
+    bool changed = false;
+    while (_oldest < seq) {
+      IndexEntry &e = _index[_oldest % _h->index_capacity];
+      if (e.seq == _oldest) {
+        BatchHeader *bh = (BatchHeader *)(_data + e.offset);
+        // stop at the first record past the write range, in ring order
+        bool behind = from < _pos && e.offset >= _pos;
+        if (!behind && (e.offset + size - from) % size >= to - from) break;
+        e.seq = 0;
+        bh->magic = 0;
+        changed = true;
+      }
+      _oldest++;
+    }
+    if (changed) {
+      std::atomic_thread_fence(std::memory_order_release);
+      commit();
+    }
+  }
+
+  void commit() {
+    recorder::Slot &s = _h->slots[_seq % 2];
+    s.checksum = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    s.seq = _seq;
+    s.write_pos = _pos;
+    s.oldest = _oldest;
+    std::atomic_thread_fence(std::memory_order_release);
+    s.checksum = recorder::checksum(s);
+  }
+};
+
+
+// Read-only view of a recording, for inspection and replay
+class FlightRecording {
+public:
+  struct Batch {
+    uint32_t n;
+    int64_t const *time;    // ns since the epoch
+    uint8_t const *columns; // channel c at columns + c * stride
+    size_t stride;
+  };
+
+  FlightRecording(std::string const &path) : _file(path, 0, false) {
+    using namespace recorder;
+    if (_file.size() < HEADER_SIZE) throw std::runtime_error("Not a flight recording: " + path);
+    _h = (FileHeader const *)_file.data();
+    if (memcmp(_h->magic, MAGIC, 8) || _h->version != VERSION || _h->file_size != _file.size())
+      throw std::runtime_error("Not a flight recording: " + path);
+    IndexEntry const *index = (IndexEntry const *)(_file.data() + _h->index_offset);
+    Slot const *s = current(_h);
+    if (!s) return; // empty
+    uint64_t first = std::max<uint64_t>(s->oldest, s->seq >= _h->index_capacity ? s->seq - _h->index_capacity + 1 : 1);
+    for (uint64_t q = first; q <= s->seq; q++) {
+      IndexEntry const &e = index[q % _h->index_capacity];
+      if (e.seq != q || e.offset + sizeof(BatchHeader) > _h->data_size) continue;
+      BatchHeader const *bh = (BatchHeader const *)(_file.data() + _h->data_offset + e.offset);
+      if (bh->magic == BATCH_MAGIC && bh->seq == q && bh->n == e.n &&
+          e.offset + bh->bytes <= _h->data_size)
+        _entries.push_back(e);
+    }
+  }
+
+  size_t channels() const { return _h->channels; }
+  size_t elem_size() const { return _h->elem_size; }
+  char elem_type() const { return _h->elem_type; }
+  std::vector<recorder::IndexEntry> const &index() const { return _entries; }
+
+  // position in index() of the first batch ending at or after t (ns since
+  // the epoch), or index().size()
+  size_t seek(int64_t t) const {
+    size_t lo = 0, hi = _entries.size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (_entries[mid].t1 < t) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo;
+  }
+
+  Batch batch(size_t i) const {
+    auto const &e = _entries[i];
+    uint8_t const *rec = _file.data() + _h->data_offset + e.offset;
+    int64_t const *t = (int64_t const *)(rec + sizeof(recorder::BatchHeader));
+    return {e.n, t, (uint8_t const *)(t + e.n), recorder::align8(e.n * _h->elem_size)};
+  }
+
+private:
+  recorder::MappedFile _file;
+  recorder::FileHeader const *_h;
+  std::vector<recorder::IndexEntry> _entries;
+};
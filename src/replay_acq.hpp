@@ -0,0 +1,158 @@
+/*
+  ____            _
+ |  _ \ ___ _ __ | | __ _ _   _
+ | |_) / _ \ '_ \| |/ _` | | | |
+ |  _ <  __/ |_) | | (_| | |_| |
+ |_| \_\___| .__/|_|\__,_|\__, |
+           |_|            |___/
+Replay acquisitor: streams a recorded capture as if it came from the device,
+for hardware-free testing and benchmarking. Sources are flight recordings
+(see recorder.hpp, memory-mapped) or CSV files (streamed), with one sample
+per line: time in seconds, then the channel values; lines that do not start
+with a number (e.g. headers) are skipped.
+Timestamps keep the recorded spacing, shifted to start now (and to follow
+on when looping), so the signal has the same sample rate whatever the replay
+speed.
+Configured by the plugin settings:
+  replay_file  = "flight.rec" # .rec: flight recording, otherwise CSV
+  replay_speed = 1.0          # 1: original timing, 2: twice as fast, ...,
+                              # 0: as fast as possible
+  replay_loop  = false        # restart from the beginning at the end
+*/
+
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include "acquisitor.hpp"
+#include "recorder.hpp"
+
+template <typename T = array<double, 3>>
+class ReplayAcquisitor : public Acquisitor<T> {
+public:
+  using typename Acquisitor<T>::sample;
+
+  ReplayAcquisitor(json j, size_t capa = 0) : Acquisitor<T>(j, capa) {
+    setup();
+  }
+
+  ~ReplayAcquisitor() { this->stop(); }
+
+  void setup() override {
+    if (_rec || _csv.is_open()) return;
+    _file = this->_settings.value("replay_file", "");
+    _speed = this->_settings.value("replay_speed", 1.0);
+    _loop = this->_settings.value("replay_loop", false);
+    if (_file.size() > 4 && _file.substr(_file.size() - 4) == ".rec") {
+      _rec = make_unique<FlightRecording>(_file);
+      if (_rec->index().empty()) throw runtime_error("Empty recording: " + _file);
+    } else {
+      _csv.open(_file);
+      if (!_csv) throw runtime_error("Cannot open " + _file);
+    }
+  }
+
+  void acquire() override {
+    if (this->is_full() || _exhausted) throw AcquisitorException();
+    int64_t t;
+    T values{};
+    if (!next(t, values)) {
+      if (!_loop || _count == 0) {
+        _exhausted = true;
+        throw AcquisitorException();
+      }
+      // next loop follows on, one sample period after the last sample
+      _offset += _last - _first + _period;
+      rewind();
+      if (!next(t, values)) throw AcquisitorException();
+    }
+    if (_count++ == 0) {
+      _first = t;
+      _wall_start = steady_clock::now();
+      _time_start = system_clock::now();
+    } else if (t > _last) {
+      _period = t - _last;
+    }
+    _last = t;
+    const int64_t elapsed = t - _first + _offset;
+    if (_speed > 0) {
+      // in slices, so that stop() is not held up by long gaps (e.g. between
+      // the sessions of a recording)
+      const auto until = _wall_start + nanoseconds((int64_t)(elapsed / _speed));
+      while (!this->_stop_requested && steady_clock::now() < until)
+        this_thread::sleep_until(min(until, steady_clock::now() + milliseconds(50)));
+    }
+    this->_data.push_back(sample{_time_start + nanoseconds(elapsed), values});
+  }
+
+  bool exhausted() const override { return _exhausted; }
+
+private:
+  string _file;
+  double _speed;
+  bool _loop;
+  unique_ptr<FlightRecording> _rec;
+  size_t _batch = 0, _index = 0;
+  ifstream _csv;
+  string _line;
+  bool _exhausted = false;
+  size_t _count = 0;
+  int64_t _first = 0, _last = 0, _period = 0, _offset = 0;
+  steady_clock::time_point _wall_start;
+  time_point<system_clock, nanoseconds> _time_start;
+
+  void rewind() {
+    _batch = _index = 0;
+    if (_csv.is_open()) {
+      _csv.clear();
+      _csv.seekg(0);
+    }
+  }
+
+  // next recorded sample: time (ns, any origin) and values
+  bool next(int64_t &t, T &values) {
+    using V = typename T::value_type;
+    if (_rec) {
+      if (_batch >= _rec->index().size()) return false;
+      auto b = _rec->batch(_batch);
+      t = b.time[_index];
+      for (size_t c = 0; c < min(values.size(), _rec->channels()); c++) {
+        uint8_t const *p = b.columns + c * b.stride + _index * _rec->elem_size();
+        values[c] = this->template to_value<V>(read_scalar(p, _rec->elem_type(), _rec->elem_size()));
+      }
+      if (++_index >= b.n) {
+        _index = 0;
+        _batch++;
+      }
+      return true;
+    }
+    while (getline(_csv, _line)) {
+      char const *p = _line.c_str();
+      char *end;
+      double v = strtod(p, &end);
+      if (end == p) continue; // header or empty line
+      t = (int64_t)llround(v * 1e9);
+      for (size_t c = 0; c < values.size(); c++) {
+        p = end + strspn(end, " \t,;");
+        v = strtod(p, &end);
+        if (end == p) break;
+        values[c] = this->template to_value<V>(v);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  static double read_scalar(uint8_t const *p, char type, size_t size) {
+    auto get = [p](auto x) {
+      memcpy(&x, p, sizeof(x));
+      return (double)x;
+    };
+    switch (type) {
+    case 'f': return size == 4 ? get(float{}) : get(double{});
+    case 'i': return size == 1 ? get(int8_t{}) : size == 2 ? get(int16_t{}) : size == 4 ? get(int32_t{}) : get(int64_t{});
+    default: return size == 1 ? get(uint8_t{}) : size == 2 ? get(uint16_t{}) : size == 4 ? get(uint32_t{}) : get(uint64_t{});
+    }
+  }
+};
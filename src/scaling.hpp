@@ -0,0 +1,87 @@
+/*
+  ____            _ _
+ / ___|  ___ __ _| (_)_ __   __ _
+ \___ \ / __/ _` | | | '_ \ / _` |
+  ___) | (_| (_| | | | | | | (_| |
+ |____/ \___\__,_|_|_|_| |_|\__, |
+                            |___/
+Conversion of raw samples (e.g. int16_t ADC counts) to engineering units,
+value * scale + offset per channel. Raw values are kept as acquired through
+the queue and the flight recorder, and converted only where processing or
+publishing needs engineering units.
+Configured by the plugin settings:
+  scale  = 1.0   # number (all channels), or list with one value per channel
+  offset = 0.0   # as above
+*/
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+class Scaling {
+public:
+  using json = nlohmann::json;
+
+  Scaling(json const &settings) {
+    _scale = coefficients(settings.value("scale", json(1.0)));
+    _offset = coefficients(settings.value("offset", json(0.0)));
+    for (double s : _scale) _identity = _identity && s == 1.0;
+    for (double o : _offset) _identity = _identity && o == 0.0;
+  }
+
+  bool identity() const { return _identity; }
+
+  // Scaled copy of a raw batch; Eng is a sample type with double data of the
+  // same size (an Acquisitor<array<double, N>>::sample)
+  template <typename Raw, typename Eng>
+  void apply(std::vector<Raw> const &raw, std::vector<Eng> &eng) {
+    eng.resize(raw.size());
+    if (raw.empty()) return;
+    const size_t nc = raw[0].data.size();
+    fit(nc);
+    double const *k = _k.data(), *o = _o.data();
+    // inner loop across channels (vectorizes for fixed-size arrays)
+    for (size_t i = 0; i < raw.size(); i++) {
+      eng[i].time = raw[i].time;
+      for (size_t c = 0; c < nc; c++)
+        eng[i].data[c] = raw[i].data[c] * k[c] + o[c];
+    }
+  }
+
+  // In place, for batches already in double
+  template <typename Sample>
+  void apply(std::vector<Sample> &batch) {
+    if (_identity || batch.empty()) return;
+    const size_t nc = batch[0].data.size();
+    fit(nc);
+    double const *k = _k.data(), *o = _o.data();
+    for (auto &s : batch)
+      for (size_t c = 0; c < nc; c++) s.data[c] = s.data[c] * k[c] + o[c];
+  }
+
+private:
+  std::vector<double> _scale, _offset; // as configured
+  std::vector<double> _k, _o;          // one per channel
+  bool _identity = true;
+
+  static std::vector<double> coefficients(json const &j) {
+    if (j.is_number()) return {j.get<double>()};
+    if (j.is_array() && !j.empty()) return j.get<std::vector<double>>();
+    throw std::invalid_argument("scale and offset must be numbers or lists of numbers");
+  }
+
+  // coefficients for nc channels: a single value applies to all of them,
+  // channels beyond a list are left unscaled
+  void fit(size_t nc) {
+    if (_k.size() == nc) return;
+    _k.assign(nc, 1.0);
+    _o.assign(nc, 0.0);
+    for (size_t c = 0; c < nc; c++) {
+      if (_scale.size() == 1) _k[c] = _scale[0];
+      else if (c < _scale.size()) _k[c] = _scale[c];
+      if (_offset.size() == 1) _o[c] = _offset[0];
+      else if (c < _offset.size()) _o[c] = _offset[c];
+    }
+  }
+};
@@ -30,6 +30,7 @@ public:
 
   // Only implement if you need cleanup
   ~SerialportAcquisitor() {
+    stop();
     if (_serial.get() != nullptr)
       _serial->close();
   }
@@ -52,6 +53,12 @@ public:
   void acquire() override {
     if (is_full()) throw AcquisitorException();
     string line = _serial->readline();
+    if (line.empty()) return; // timeout: no sample this time
+    _data.push_back(parse(line));
+  }
+
+  // Parse a line read from the device into a sample timestamped now
+  static sample parse(string const &line) {
     json j;
     try {
       j = json::parse(line);
@@ -61,11 +68,10 @@ public:
 
     // Careful with this: here we expect a JSON string with fields nested
     // into ["data"]
-    Acquisitor::sample s{
+    return Acquisitor::sample{
       system_clock::now(),
       {j["data"].value("AI1", 0.0), j["data"].value("AI2", 0.0), j["data"].value("AI3", 0.0)}
     };
-    _data.push_back(s);
   }
 
 private:
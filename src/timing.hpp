@@ -0,0 +1,101 @@
+/*
+  _____ _           _
+ |_   _(_)_ __ ___ (_)_ __   __ _
+   | | | | '_ ` _ \| | '_ \ / _` |
+   | | | | | | | | | | | | | (_| |
+   |_| |_|_| |_| |_|_|_| |_|\__, |
+                            |___/
+Hot-path timing instrumentation: latency histograms with HDR-style buckets
+(16 linear sub-buckets per power of two, i.e. ~6% resolution over the whole
+range from 1 ns up), updated with relaxed atomics so that the acquisition
+thread and the main thread can record without locks.
+Everything is compiled only when BUFFERED_TIMING is defined (CMake option of
+the same name); otherwise the TIMING_* macros expand to nothing.
+*/
+#pragma once
+
+#ifdef BUFFERED_TIMING
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+
+#define TIMING_START(t) auto t = std::chrono::steady_clock::now()
+#define TIMING_RECORD(hist, t) (hist).record(std::chrono::steady_clock::now() - (t))
+
+class LatencyHistogram {
+public:
+  static constexpr unsigned SUB_BITS = 4, SUB = 1u << SUB_BITS;
+  static constexpr size_t BUCKETS = SUB + (64 - SUB_BITS) * SUB;
+
+  void record(std::chrono::nanoseconds d) { record_ns(d.count() > 0 ? d.count() : 0); }
+
+  void record_ns(uint64_t v) {
+    _buckets[index(v)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(v, std::memory_order_relaxed);
+    uint64_t m = _max.load(std::memory_order_relaxed);
+    while (v > m && !_max.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+  }
+
+  uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+  uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+  double mean() const { return count() ? double(_sum.load(std::memory_order_relaxed)) / count() : 0.0; }
+
+  // p-th percentile (0 < p <= 100) in ns, as the midpoint of its bucket
+  double percentile(double p) const {
+    uint64_t n = count();
+    if (n == 0) return 0.0;
+    uint64_t rank = (uint64_t)(p / 100.0 * n + 0.5), seen = 0;
+    if (rank < 1) rank = 1;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      seen += _buckets[i].load(std::memory_order_relaxed);
+      if (seen >= rank) return std::min(midpoint(i), double(max()));
+    }
+    return double(max());
+  }
+
+  void reset() {
+    for (auto &b : _buckets) b.store(0, std::memory_order_relaxed);
+    _count = _sum = _max = 0;
+  }
+
+  // Summary in milliseconds
+  nlohmann::json to_json() const {
+    return {
+      {"count", count()},
+      {"mean", mean() / 1e6},
+      {"p50", percentile(50) / 1e6},
+      {"p90", percentile(90) / 1e6},
+      {"p99", percentile(99) / 1e6},
+      {"max", max() / 1e6}
+    };
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, BUCKETS> _buckets{};
+  std::atomic<uint64_t> _count = 0, _sum = 0, _max = 0;
+
+  static size_t index(uint64_t v) {
+    if (v < SUB) return v;
+    unsigned shift = std::bit_width(v) - 1 - SUB_BITS;
+    return SUB + shift * SUB + ((v >> shift) - SUB);
+  }
+  static double midpoint(size_t i) {
+    if (i < SUB) return double(i);
+    unsigned shift = (i - SUB) / SUB;
+    uint64_t lo = (uint64_t)(SUB + (i - SUB) % SUB) << shift;
+    return lo + ((uint64_t)1 << shift) / 2.0;
+  }
+};
+
+#else
+
+#define TIMING_START(t)
+#define TIMING_RECORD(hist, t)
+
+#endif
@@ -0,0 +1,192 @@
+/*
+  _____     _
+ |_   _| __(_) __ _  __ _  ___ _ __
+   | || '__| |/ _` |/ _` |/ _ \ '__|
+   | || |  | | (_| | (_| |  __/ |
+   |_||_|  |_|\__, |\__, |\___|_|
+              |___/ |___/
+Triggered capture: only short windows of samples around events are kept.
+A detector runs on one channel, and when its value crosses the trigger level
+a window is captured, made of the last pre_trigger samples (kept in a ring)
+followed by post_trigger samples starting with the trigger sample. Captures
+can span batches.
+Configured by the plugin settings:
+  trigger            = "level" # level, slope (units/s), or rms
+  trigger_channel    = 0       # index, or name in channels
+  trigger_level      = 1.0     # threshold on the detector value
+  trigger_edge       = "rising" # rising, falling, or both
+  trigger_window     = 16      # samples, for rms
+  pre_trigger        = 100     # samples before the trigger
+  post_trigger       = 100     # samples from the trigger on
+  trigger_holdoff_ms = 0.0     # min time between triggers
+  max_event_rate     = 0.0     # events/s (token bucket), 0: unlimited
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Sample is an Acquisitor<T>::sample
+template <typename Sample>
+class TriggerCapture {
+public:
+  using json = nlohmann::json;
+  using time_point = decltype(Sample::time);
+
+  struct Event {
+    time_point time;              // timestamp of the trigger sample
+    size_t pre = 0;               // number of samples before the trigger
+    std::vector<Sample> samples;
+  };
+
+  TriggerCapture(json const &settings) {
+    std::string mode = settings.value("trigger", "level");
+    if (mode == "level") _mode = LEVEL;
+    else if (mode == "slope") _mode = SLOPE;
+    else if (mode == "rms") _mode = RMS;
+    else throw std::invalid_argument("Unknown trigger mode: " + mode);
+    std::string edge = settings.value("trigger_edge", "rising");
+    if (edge != "rising" && edge != "falling" && edge != "both")
+      throw std::invalid_argument("Unknown trigger edge: " + edge);
+    _rising = (edge != "falling");
+    _falling = (edge != "rising");
+
+    json ch = settings.value("trigger_channel", json(0));
+    if (ch.is_string()) {
+      auto names = settings.value("channels", std::vector<std::string>{});
+      auto it = std::find(names.begin(), names.end(), ch.get<std::string>());
+      if (it == names.end())
+        throw std::invalid_argument("Unknown trigger channel: " + ch.get<std::string>());
+      _channel = it - names.begin();
+    } else {
+      _channel = ch.get<size_t>();
+    }
+    if (_channel >= std::tuple_size_v<decltype(Sample::data)>)
+      throw std::invalid_argument("Trigger channel out of range: " + std::to_string(_channel));
+    _level = settings.value("trigger_level", 1.0);
+    _sq.assign(std::max<size_t>(1, settings.value("trigger_window", 16)), 0.0);
+    _ring.resize(settings.value("pre_trigger", 100));
+    _post = std::max<size_t>(1, settings.value("post_trigger", 100));
+    _holdoff = std::chrono::duration<double, std::milli>(settings.value("trigger_holdoff_ms", 0.0));
+    _rate = settings.value("max_event_rate", 0.0);
+    _tokens = std::max(1.0, _rate);
+  }
+
+  size_t channel() const { return _channel; }
+  size_t events() const { return _events; }
+  size_t suppressed() const { return _suppressed; }
+
+  // Feed a batch; returns the captures completed within it
+  std::vector<Event> process(std::vector<Sample> const &batch) {
+    std::vector<Event> done;
+    for (auto const &s : batch) {
+      bool above = detect(s);
+      bool edge = _started && ((_rising && above && !_above) ||
+                               (_falling && !above && _above));
+      _above = above;
+      _started = true;
+
+      if (_capturing) {
+        _event.samples.push_back(s);
+      } else if (edge && allowed(s.time)) {
+        _capturing = true;
+        _event.time = s.time;
+        _event.pre = _count;
+        _event.samples.clear();
+        _event.samples.reserve(_count + _post);
+        for (size_t i = 0; i < _count; i++)
+          _event.samples.push_back(_ring[(_head + _ring.size() - _count + i) % _ring.size()]);
+        _event.samples.push_back(s);
+        _events++;
+      }
+      if (_capturing && _event.samples.size() == _event.pre + _post) {
+        done.push_back(std::move(_event));
+        _event = Event{};
+        _capturing = false;
+      }
+
+      if (!_ring.empty()) {
+        _ring[_head] = s;
+        _head = (_head + 1) % _ring.size();
+        _count = std::min(_count + 1, _ring.size());
+      }
+    }
+    return done;
+  }
+
+private:
+  enum { LEVEL, SLOPE, RMS } _mode;
+  bool _rising, _falling;
+  size_t _channel;
+  double _level;
+  size_t _post;
+  std::chrono::duration<double, std::milli> _holdoff;
+  double _rate, _tokens;
+
+  // detector state
+  bool _started = false, _above = false;
+  double _prev = 0, _slope = 0;
+  time_point _prev_time{}, _last_trigger{}, _last_refill{};
+  std::vector<double> _sq; // squares, for rms
+  size_t _sq_head = 0, _sq_count = 0;
+  double _sq_sum = 0;
+
+  // pre-trigger ring and capture in progress
+  std::vector<Sample> _ring;
+  size_t _head = 0, _count = 0;
+  bool _capturing = false;
+  Event _event;
+  size_t _events = 0, _suppressed = 0;
+
+  // whether the detector value is above the trigger level
+  bool detect(Sample const &s) {
+    const double v = s.data[_channel];
+    double x = v;
+    if (_mode == SLOPE) {
+      double dt = std::chrono::duration<double>(s.time - _prev_time).count();
+      if (_started && dt > 0) _slope = (v - _prev) / dt;
+      x = _slope;
+    } else if (_mode == RMS) {
+      _sq_sum += v * v - _sq[_sq_head];
+      _sq[_sq_head] = v * v;
+      _sq_head = (_sq_head + 1) % _sq.size();
+      if (_sq_count < _sq.size()) _sq_count++;
+      if (_sq_head == 0) { // exact sum once per window, against drift
+        _sq_sum = 0;
+        for (double q : _sq) _sq_sum += q;
+      }
+      x = std::sqrt(std::max(0.0, _sq_sum) / _sq_count);
+    }
+    _prev = v;
+    _prev_time = s.time;
+    return x >= _level;
+  }
+
+  // hold-off and token bucket (burst: one second worth of events)
+  bool allowed(time_point t) {
+    if (_events > 0 && t - _last_trigger < _holdoff) {
+      _suppressed++;
+      return false;
+    }
+    if (_rate > 0) {
+      if (_last_refill != time_point{}) {
+        double dt = std::chrono::duration<double>(t - _last_refill).count();
+        _tokens = std::min(std::max(1.0, _rate), _tokens + dt * _rate);
+      }
+      _last_refill = t;
+      if (_tokens < 1) {
+        _suppressed++;
+        return false;
+      }
+      _tokens -= 1;
+    }
+    _last_trigger = t;
+    return true;
+  }
+};